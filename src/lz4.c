@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lz4.h"
+
+/* A compressed block is a sequence of sequences, each consisting of:
+ *
+ *  - a token, the high nibble holds the number of literals, the low one
+ *    the match length minus MINMATCH. a value of 15 indicates that the
+ *    length continues in additional bytes which are summed up until one
+ *    of them is smaller than 255
+ *  - the literals
+ *  - a 2 byte little endian offset to the start of the match
+ *
+ * The last sequence only consists of literals. The last match has to
+ * start at least MFLIMIT bytes before the end of the input, the last
+ * LASTLITERALS bytes are always literals.
+ */
+#define MINMATCH 4
+#define LASTLITERALS 5
+#define MFLIMIT 12
+#define MAXOFFSET 65535
+#define HASH_LOG 16
+
+static uint32_t read32(const unsigned char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof v);
+	return v;
+}
+
+static uint32_t hash(uint32_t v) {
+	return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static unsigned char *length_put(unsigned char *op, size_t len) {
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = len;
+	return op;
+}
+
+static bool length_get(const unsigned char **ip, const unsigned char *iend, size_t *len) {
+	unsigned char b;
+	do {
+		if (*ip >= iend)
+			return false;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return true;
+}
+
+static unsigned char *sequence_put(unsigned char *op, const unsigned char *lit, size_t litlen) {
+	*op++ = (litlen >= 15 ? 15 : litlen) << 4;
+	if (litlen >= 15)
+		op = length_put(op, litlen - 15);
+	memcpy(op, lit, litlen);
+	return op + litlen;
+}
+
+size_t lz4_compress_bound(size_t len) {
+	return len + len / 255 + 16;
+}
+
+size_t lz4_compress(const char *src, size_t len, char *dst) {
+	if (len > UINT32_MAX)
+		return 0;
+	const unsigned char *base = (const unsigned char*)src;
+	const unsigned char *ip = base, *anchor = base, *end = base + len;
+	unsigned char *op = (unsigned char*)dst;
+
+	if (len > MFLIMIT) {
+		uint32_t *table = calloc(1 << HASH_LOG, sizeof *table);
+		if (!table)
+			return 0;
+		const unsigned char *mflimit = end - MFLIMIT;
+		const unsigned char *matchlimit = end - LASTLITERALS;
+		while (ip < mflimit) {
+			uint32_t seq = read32(ip);
+			uint32_t h = hash(seq);
+			const unsigned char *ref = base + table[h];
+			table[h] = ip - base;
+			if (ref >= ip || ip - ref > MAXOFFSET || read32(ref) != seq) {
+				ip++;
+				continue;
+			}
+			while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+			const unsigned char *m = ip + MINMATCH, *r = ref + MINMATCH;
+			while (m < matchlimit && *m == *r) {
+				m++;
+				r++;
+			}
+			size_t mlen = m - ip - MINMATCH;
+			unsigned char *token = op;
+			op = sequence_put(op, anchor, ip - anchor);
+			*token |= mlen >= 15 ? 15 : mlen;
+			*op++ = (ip - ref) & 0xff;
+			*op++ = (ip - ref) >> 8;
+			if (mlen >= 15)
+				op = length_put(op, mlen - 15);
+			ip = anchor = m;
+		}
+		free(table);
+	}
+
+	op = sequence_put(op, anchor, end - anchor);
+	return op - (unsigned char*)dst;
+}
+
+bool lz4_decompress(const char *src, size_t srclen, char *dst, size_t len) {
+	const unsigned char *ip = (const unsigned char*)src, *iend = ip + srclen;
+	unsigned char *op = (unsigned char*)dst, *oend = op + len;
+
+	for (;;) {
+		if (ip >= iend)
+			return false;
+		unsigned char token = *ip++;
+		size_t litlen = token >> 4;
+		if (litlen == 15 && !length_get(&ip, iend, &litlen))
+			return false;
+		if (litlen > (size_t)(iend - ip) || litlen > (size_t)(oend - op))
+			return false;
+		memcpy(op, ip, litlen);
+		op += litlen;
+		ip += litlen;
+		if (ip == iend)
+			return op == oend;
+		if (iend - ip < 2)
+			return false;
+		size_t off = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (off == 0 || off > (size_t)(op - (unsigned char*)dst))
+			return false;
+		size_t mlen = token & 15;
+		if (mlen == 15 && !length_get(&ip, iend, &mlen))
+			return false;
+		mlen += MINMATCH;
+		if (mlen > (size_t)(oend - op))
+			return false;
+		const unsigned char *ref = op - off;
+		if (off >= mlen) {
+			memcpy(op, ref, mlen);
+			op += mlen;
+		} else {
+			while (mlen--)
+				*op++ = *ref++;
+		}
+	}
+}
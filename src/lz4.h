@@ -0,0 +1,20 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+/* minimal implementation of the LZ4 block format, used to compress
+ * insertion blocks which are only referenced from the undo history */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* maximal size of the compressed representation of len bytes */
+size_t lz4_compress_bound(size_t len);
+/* compress len bytes from src into dst which must provide at least
+ * lz4_compress_bound(len) bytes. returns the compressed size or zero
+ * if len is too large or memory allocation failed */
+size_t lz4_compress(const char *src, size_t len, char *dst);
+/* decompress srclen bytes from src into dst, which must decode to
+ * exactly len bytes. returns false for malformed input */
+bool lz4_decompress(const char *src, size_t srclen, char *dst, size_t len);
+
+#endif
@@ -0,0 +1,463 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* qsort_r(3) is non-standard */
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TEDDY_SSSE3 1
+#endif
+#include "text-find.h"
+#include "util.h"
+
+/* largest pattern set handled by the fingerprint matcher */
+#ifndef TEDDY_PATTERNS
+#define TEDDY_PATTERNS 64
+#endif
+
+/* number of leading bytes of each pattern used as fingerprint */
+#define TEDDY_FINGERPRINT 3
+#define TEDDY_BUCKETS 8
+
+#define NONE ((uint32_t)-1)
+
+struct Literals {
+	size_t count;
+	char **patterns;                   /* NULL for empty patterns */
+	size_t *lens;
+	size_t maxlen;
+	bool teddy;
+	/* Teddy: patterns are distributed into 8 buckets, for every fingerprint
+	 * byte i and nibble value the tables contain a bitmask of the buckets with
+	 * a pattern whose i-th byte has this low respectively high nibble */
+	size_t fingerprint;
+	uint8_t lo[TEDDY_FINGERPRINT][16];
+	uint8_t hi[TEDDY_FINGERPRINT][16];
+	size_t bucket[TEDDY_BUCKETS+1];    /* start of each bucket in order */
+	uint32_t *order;                   /* pattern indices, ascending per bucket */
+	/* Aho-Corasick: deterministic automaton over byte classes */
+	uint16_t class[256];
+	size_t classes;
+	uint32_t *delta;                   /* states * classes transitions */
+	uint32_t *out;                     /* longest pattern ending in a state */
+};
+
+/* compare len bytes of the text at it->text + off, possibly spanning pieces */
+static bool match_at(const Iterator *it, size_t off, const char *s, size_t len) {
+	Iterator p = *it;
+	const char *cur = p.text + off;
+	while (len > 0) {
+		size_t n = MIN(len, (size_t)(p.end - cur));
+		if (memcmp(cur, s, n))
+			return false;
+		s += n;
+		len -= n;
+		if (len > 0) {
+			if (!text_iterator_next(&p))
+				return false;
+			cur = p.text;
+		}
+	}
+	return true;
+}
+
+static int fingerprint_cmp(const void *a, const void *b, void *arg) {
+	const Literals *l = arg;
+	uint32_t i = *(const uint32_t*)a, j = *(const uint32_t*)b;
+	int r = memcmp(l->patterns[i], l->patterns[j], l->fingerprint);
+	return r ? r : (i > j) - (i < j);
+}
+
+static int index_cmp(const void *a, const void *b) {
+	uint32_t i = *(const uint32_t*)a, j = *(const uint32_t*)b;
+	return (i > j) - (i < j);
+}
+
+static bool teddy_init(Literals *l, size_t active, size_t minlen) {
+	l->order = malloc(active * sizeof *l->order);
+	if (!l->order)
+		return false;
+	l->fingerprint = MIN(minlen, TEDDY_FINGERPRINT);
+	for (size_t i = 0, j = 0; i < l->count; i++) {
+		if (l->patterns[i])
+			l->order[j++] = i;
+	}
+	/* patterns with similar fingerprints share a bucket */
+	if (active > TEDDY_BUCKETS)
+		qsort_r(l->order, active, sizeof *l->order, fingerprint_cmp, l);
+	size_t per = (active + TEDDY_BUCKETS - 1) / TEDDY_BUCKETS;
+	for (size_t b = 0; b <= TEDDY_BUCKETS; b++)
+		l->bucket[b] = MIN(b * per, active);
+	for (size_t b = 0; b < TEDDY_BUCKETS; b++) {
+		uint32_t *p = l->order + l->bucket[b];
+		size_t n = l->bucket[b+1] - l->bucket[b];
+		qsort(p, n, sizeof *p, index_cmp);
+		for (size_t j = 0; j < n; j++) {
+			const unsigned char *s = (const unsigned char*)l->patterns[p[j]];
+			for (size_t i = 0; i < l->fingerprint; i++) {
+				l->lo[i][s[i] & 0xF] |= 1 << b;
+				l->hi[i][s[i] >> 4] |= 1 << b;
+			}
+		}
+	}
+	return true;
+}
+
+/* buckets whose fingerprint matches the bytes at s */
+static unsigned int teddy_buckets(const Literals *l, const unsigned char *s) {
+	unsigned int buckets = 0xFF;
+	for (size_t i = 0; i < l->fingerprint; i++)
+		buckets &= l->lo[i][s[i] & 0xF] & l->hi[i][s[i] >> 4];
+	return buckets;
+}
+
+/* first pattern of the given buckets occurring at it->text + off */
+static uint32_t teddy_verify(const Literals *l, const Iterator *it, size_t off, size_t len, unsigned int buckets) {
+	uint32_t best = NONE;
+	for (; buckets; buckets &= buckets - 1) {
+		size_t b = __builtin_ctz(buckets);
+		for (size_t j = l->bucket[b]; j < l->bucket[b+1]; j++) {
+			uint32_t i = l->order[j];
+			if (i >= best)
+				break;
+			size_t n = l->lens[i];
+			if (off + n <= len ? !memcmp(it->text + off, l->patterns[i], n) : match_at(it, off, l->patterns[i], n)) {
+				best = i;
+				break;
+			}
+		}
+	}
+	return best;
+}
+
+#if TEDDY_SSSE3
+/* leading part of the chunk processed 16 candidate positions at a time,
+ * returns the offset of the first unprocessed position */
+__attribute__((target("ssse3")))
+static size_t teddy_chunk_ssse3(const Literals *l, const Iterator *it, size_t len, size_t *match, uint32_t *which) {
+	const unsigned char *s = (const unsigned char*)it->text;
+	const __m128i nibble = _mm_set1_epi8(0xF);
+	__m128i lo[TEDDY_FINGERPRINT], hi[TEDDY_FINGERPRINT];
+	size_t fingerprint = l->fingerprint, off = 0;
+	for (size_t i = 0; i < fingerprint; i++) {
+		lo[i] = _mm_loadu_si128((const __m128i*)l->lo[i]);
+		hi[i] = _mm_loadu_si128((const __m128i*)l->hi[i]);
+	}
+	for (; off + 16 + fingerprint - 1 <= len; off += 16) {
+		__m128i r = _mm_set1_epi8((char)0xFF);
+		for (size_t i = 0; i < fingerprint; i++) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(s + off + i));
+			__m128i vlo = _mm_shuffle_epi8(lo[i], _mm_and_si128(v, nibble));
+			__m128i vhi = _mm_shuffle_epi8(hi[i], _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+			r = _mm_and_si128(r, _mm_and_si128(vlo, vhi));
+		}
+		unsigned int m = _mm_movemask_epi8(_mm_cmpeq_epi8(r, _mm_setzero_si128())) ^ 0xFFFF;
+		if (!m)
+			continue;
+		uint8_t res[16];
+		_mm_storeu_si128((__m128i*)res, r);
+		for (; m; m &= m - 1) {
+			size_t j = __builtin_ctz(m);
+			if ((*which = teddy_verify(l, it, off + j, len, res[j])) != NONE) {
+				*match = off + j;
+				return off;
+			}
+		}
+	}
+	return off;
+}
+#endif
+
+/* leftmost match within the contiguous chunk at the iterator position */
+static size_t teddy_chunk(const Literals *l, const Iterator *it, size_t len, uint32_t *which) {
+	const unsigned char *s = (const unsigned char*)it->text;
+	size_t off = 0, match = EPOS;
+#if TEDDY_SSSE3
+	off = teddy_chunk_ssse3(l, it, len, &match, which);
+	if (match != EPOS)
+		return match;
+#endif
+	for (; off < len; off++) {
+		/* fingerprints extending into the next piece are not checked */
+		unsigned int buckets = off + l->fingerprint <= len ? teddy_buckets(l, s + off) : 0xFF;
+		if (buckets && (*which = teddy_verify(l, it, off, len, buckets)) != NONE)
+			return off;
+	}
+	return EPOS;
+}
+
+static size_t teddy_next(const Literals *l, Text *txt, size_t pos, size_t limit, uint32_t *which) {
+	for (Iterator it = text_iterator_get(txt, pos); text_iterator_valid(&it) && it.pos < limit; text_iterator_next(&it)) {
+		size_t off = teddy_chunk(l, &it, MIN((size_t)(it.end - it.text), limit - it.pos), which);
+		if (off != EPOS)
+			return it.pos + off;
+	}
+	return EPOS;
+}
+
+static bool aho_corasick_init(Literals *l, size_t total) {
+	for (size_t i = 0; i < l->count; i++) {
+		for (const unsigned char *c = (const unsigned char*)l->patterns[i]; c && *c; c++) {
+			if (!l->class[*c])
+				l->class[*c] = ++l->classes;
+		}
+	}
+	size_t classes = ++l->classes;
+	size_t states = total + 1;
+	l->delta = calloc(states * classes, sizeof *l->delta);
+	l->out = malloc(states * sizeof *l->out);
+	uint32_t *fail = calloc(states, sizeof *fail);
+	uint32_t *queue = malloc(states * sizeof *queue);
+	if (!l->delta || !l->out || !fail || !queue) {
+		free(fail);
+		free(queue);
+		return false;
+	}
+
+	/* build the trie, 0 doubles as missing edge since the root has no parent */
+	uint32_t *delta = l->delta;
+	size_t used = 1;
+	l->out[0] = NONE;
+	for (size_t i = 0; i < l->count; i++) {
+		if (!l->patterns[i])
+			continue;
+		uint32_t s = 0;
+		for (const unsigned char *c = (const unsigned char*)l->patterns[i]; *c; c++) {
+			uint32_t *t = &delta[s * classes + l->class[*c]];
+			if (!*t) {
+				l->out[used] = NONE;
+				*t = used++;
+			}
+			s = *t;
+		}
+		if (l->out[s] == NONE)
+			l->out[s] = i;
+	}
+
+	/* turn the trie into a DFA in breadth first order, the fail state of
+	 * every state is less deep and hence already complete */
+	size_t head = 0, tail = 0;
+	for (size_t c = 0; c < classes; c++) {
+		if (delta[c])
+			queue[tail++] = delta[c];
+	}
+	while (head < tail) {
+		uint32_t s = queue[head++];
+		if (l->out[s] == NONE)
+			l->out[s] = l->out[fail[s]];
+		for (size_t c = 0; c < classes; c++) {
+			uint32_t *t = &delta[s * classes + c];
+			uint32_t f = delta[fail[s] * classes + c];
+			if (*t) {
+				fail[*t] = f;
+				queue[tail++] = *t;
+			} else {
+				*t = f;
+			}
+		}
+	}
+	free(fail);
+	free(queue);
+	return true;
+}
+
+static size_t aho_corasick_next(const Literals *l, Text *txt, size_t pos, size_t limit, uint32_t *which) {
+	size_t classes = l->classes, start = EPOS, stop = EPOS;
+	uint32_t s = 0;
+	for (Iterator it = text_iterator_get(txt, pos); text_iterator_valid(&it); text_iterator_next(&it)) {
+		const unsigned char *cur = (const unsigned char*)it.text, *end = (const unsigned char*)it.end;
+		for (size_t p = it.pos; cur < end; cur++, p++) {
+			/* no match starting before limit can still be completed */
+			if (p > stop || (p >= limit && p - limit >= l->maxlen - 1))
+				return start < limit ? start : EPOS;
+			s = l->delta[s * classes + l->class[*cur]];
+			uint32_t i = l->out[s];
+			if (i == NONE)
+				continue;
+			/* a match ending later can start earlier */
+			size_t m = p + 1 - l->lens[i];
+			if (m < start || (m == start && i < *which)) {
+				start = m;
+				*which = i;
+				stop = m + l->maxlen - 1;
+			}
+		}
+	}
+	return start < limit ? start : EPOS;
+}
+
+Literals *text_literals_new(const char *patterns[], size_t n) {
+	Literals *l = calloc(1, sizeof *l);
+	if (!l)
+		return NULL;
+	l->count = n;
+	l->patterns = calloc(n, sizeof *l->patterns);
+	l->lens = calloc(n, sizeof *l->lens);
+	if (!l->patterns || !l->lens)
+		goto err;
+	size_t active = 0, total = 0, minlen = SIZE_MAX;
+	for (size_t i = 0; i < n; i++) {
+		size_t len = patterns[i] ? strlen(patterns[i]) : 0;
+		if (!len)
+			continue;
+		if (!(l->patterns[i] = strdup(patterns[i])))
+			goto err;
+		l->lens[i] = len;
+		l->maxlen = MAX(l->maxlen, len);
+		minlen = MIN(minlen, len);
+		total += len;
+		active++;
+	}
+	if (total >= NONE)
+		goto err;
+	if (active == 0)
+		return l;
+#if TEDDY_SSSE3
+	__builtin_cpu_init();
+	l->teddy = active <= TEDDY_PATTERNS && __builtin_cpu_supports("ssse3");
+#endif
+	if (l->teddy ? teddy_init(l, active, minlen) : aho_corasick_init(l, total))
+		return l;
+err:
+	text_literals_free(l);
+	return NULL;
+}
+
+void text_literals_free(Literals *l) {
+	if (!l)
+		return;
+	for (size_t i = 0; i < l->count && l->patterns; i++)
+		free(l->patterns[i]);
+	free(l->patterns);
+	free(l->lens);
+	free(l->order);
+	free(l->delta);
+	free(l->out);
+	free(l);
+}
+
+/* leftmost occurrence starting in [pos, end) */
+static size_t literals_next(Literals *l, Text *txt, size_t pos, size_t end, size_t *which) {
+	if (!l || l->maxlen == 0)
+		return EPOS;
+	uint32_t i = NONE;
+	size_t match = l->teddy ? teddy_next(l, txt, pos, end, &i) : aho_corasick_next(l, txt, pos, end, &i);
+	if (match != EPOS && which)
+		*which = i;
+	return match;
+}
+
+size_t text_literals_next(Literals *l, Text *txt, size_t pos, size_t *which) {
+	return literals_next(l, txt, pos, EPOS, which);
+}
+
+size_t text_find_any_next(Text *txt, size_t pos, const char *patterns[], size_t n, size_t *which) {
+	Literals *l = text_literals_new(patterns, n);
+	size_t match = text_literals_next(l, txt, pos, which);
+	text_literals_free(l);
+	return match;
+}
+
+/* a pattern prefix and its first occurrence in the order of the session */
+typedef struct {
+	size_t len;
+	size_t pos;
+} FindLevel;
+
+struct FindSession {
+	Text *txt;
+	size_t from;            /* occurrences at or after from come first */
+	size_t pos;             /* then those before it which end at or before pos */
+	char *pattern;          /* pattern of the last update */
+	size_t size;            /* allocated bytes of pattern */
+	FindLevel *levels;      /* prefixes of pattern searched so far, by increasing length */
+	size_t count, alloc;
+	size_t searched;        /* bytes passed by the searches, for statistics */
+};
+
+/* first occurrence of the pattern of length len in the order of the
+ * session, none of which precedes pos */
+static size_t session_search(FindSession *s, const char *pattern, size_t len, size_t pos) {
+	const char *patterns[] = { pattern };
+	Literals *l = text_literals_new(patterns, 1);
+	if (!l)
+		return EPOS;
+	size_t match = EPOS, size = text_size(s->txt);
+	if (pos >= s->from) {
+		match = literals_next(l, s->txt, pos, EPOS, NULL);
+		s->searched += (match == EPOS ? size : match) - pos;
+		pos = 0;
+	}
+	/* like text_search_forward, the occurrences before from have to end
+	 * at or before the initial position */
+	size_t end = s->pos >= len ? s->pos - len + 1 : 0;
+	if (match == EPOS && pos < end) {
+		match = literals_next(l, s->txt, pos, end, NULL);
+		s->searched += (match == EPOS ? end : match) - pos;
+	}
+	text_literals_free(l);
+	return match;
+}
+
+FindSession *text_find_session_new(Text *txt, size_t pos) {
+	FindSession *s = calloc(1, sizeof *s);
+	if (!s)
+		return NULL;
+	s->txt = txt;
+	s->pos = MIN(pos, text_size(txt));
+	s->from = MIN(pos + 1, text_size(txt));
+	s->alloc = 16;
+	s->levels = malloc(s->alloc * sizeof *s->levels);
+	if (!s->levels) {
+		free(s);
+		return NULL;
+	}
+	/* the empty pattern bounds the search of every other one */
+	s->levels[s->count++] = (FindLevel){ .len = 0, .pos = s->from };
+	return s;
+}
+
+void text_find_session_free(FindSession *s) {
+	if (!s)
+		return;
+	free(s->pattern);
+	free(s->levels);
+	free(s);
+}
+
+size_t text_find_session_update(FindSession *s, const char *pattern) {
+	size_t len = strlen(pattern), common = 0;
+	while (s->pattern && s->pattern[common] && s->pattern[common] == pattern[common])
+		common++;
+	/* the prefixes shared with the new pattern remain valid, an occurrence
+	 * of the latter is one of each of them too and thus can not come before
+	 * the first occurrence of the longest */
+	while (s->levels[s->count-1].len > common)
+		s->count--;
+	FindLevel *top = &s->levels[s->count-1];
+	if (top->len == len)
+		return len ? top->pos : EPOS;
+	if (len >= s->size) {
+		char *p = realloc(s->pattern, len + 1);
+		if (!p)
+			return EPOS;
+		s->pattern = p;
+		s->size = len + 1;
+	}
+	memcpy(s->pattern, pattern, len + 1);
+	size_t match = top->pos == EPOS ? EPOS : session_search(s, pattern, len, top->pos);
+	if (s->count == s->alloc) {
+		FindLevel *levels = realloc(s->levels, 2 * s->alloc * sizeof *levels);
+		if (!levels)
+			return match;
+		s->levels = levels;
+		s->alloc *= 2;
+	}
+	s->levels[s->count++] = (FindLevel){ .len = len, .pos = match };
+	return match;
+}
+
+size_t text_find_session_searched(FindSession *s) {
+	return s->searched;
+}
@@ -0,0 +1,42 @@
+#ifndef TEXT_FIND_H
+#define TEXT_FIND_H
+
+/* search for the leftmost occurrence of any of a set of literal patterns.
+ * small sets are matched by comparing packed fingerprints of the first bytes
+ * of all patterns at once (Teddy) and verifying the candidates, large sets or
+ * CPUs without SSSE3 use an Aho-Corasick automaton. both stream across the
+ * pieces of the text without copying it. */
+
+#include <stddef.h>
+#include "text.h"
+
+typedef struct Literals Literals;
+
+/* compile n NUL terminated patterns, empty patterns never match */
+Literals *text_literals_new(const char *patterns[], size_t n);
+void text_literals_free(Literals*);
+/* position of the leftmost occurrence at or after pos of any pattern, or EPOS.
+ * if several patterns match at this position the one which comes first in the
+ * pattern array is reported in which (unless it is NULL) */
+size_t text_literals_next(Literals*, Text*, size_t pos, size_t *which);
+/* same as above, but compiles the patterns for a single search */
+size_t text_find_any_next(Text*, size_t pos, const char *patterns[], size_t n, size_t *which);
+
+/* incremental search for a literal pattern as it is typed. the first
+ * occurrence of a pattern extending the previous one can not precede the
+ * first occurrence of the latter, hence the search resumes there instead of
+ * at the start. the results of all shorter prefixes are kept, deleting
+ * characters does not search at all. the text must not be modified while
+ * the session is in use. */
+typedef struct FindSession FindSession;
+
+/* occurrences starting after pos are found first, then those ending at or
+ * before it, in the same order as text_search_forward */
+FindSession *text_find_session_new(Text*, size_t pos);
+void text_find_session_free(FindSession*);
+/* position of the first occurrence of the NUL terminated pattern, or EPOS */
+size_t text_find_session_update(FindSession*, const char *pattern);
+/* number of bytes searched by all updates so far */
+size_t text_find_session_searched(FindSession*);
+
+#endif
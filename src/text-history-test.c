@@ -0,0 +1,115 @@
+/* checks that long jumps through the undo history, which install a
+ * checkpoint and replay the remaining revisions, restore the content of
+ * the target revision and keep a match index up to date. run `make test` */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "text.h"
+#include "text-regex.h"
+#include "text-match-index.h"
+
+/* number of revisions created on the first branch */
+#define REVISIONS 150
+
+static const char *patterns[] = { "ab", "b\na" };
+static const char *fragments[] = { "ab", "a", "b", "\n", "xy" };
+
+typedef struct {
+	RegexMatch *data;
+	size_t count, size;
+} Matches;
+
+static bool matches_add(const RegexMatch pmatch[], size_t nmatch, void *data) {
+	Matches *m = data;
+	(void)nmatch;
+	if (m->count == m->size) {
+		size_t size = m->size ? 2 * m->size : 64;
+		RegexMatch *matches = realloc(m->data, size * sizeof *matches);
+		if (!matches)
+			return false;
+		m->data = matches;
+		m->size = size;
+	}
+	m->data[m->count++] = pmatch[0];
+	return true;
+}
+
+/* compare the text against the expected content and the indexed matches
+ * against the ones found by searching the whole text */
+static bool check(Text *txt, MatchIndex *index, Regex *r, const char *content, const char *what) {
+	bool ok = true;
+	size_t size = text_size(txt);
+	char *bytes = text_bytes_alloc0(txt, 0, size);
+	if (!bytes || size != strlen(content) || memcmp(bytes, content, size)) {
+		printf("%s: content differs\n", what);
+		ok = false;
+	}
+	free(bytes);
+	Matches expected = { 0 };
+	text_search_all(txt, 0, size, r, 1, 0, matches_add, &expected);
+	size_t count;
+	const RegexMatch *matches = text_match_index_get(index, 0, EPOS, &count);
+	if (count != expected.count || (count && memcmp(matches, expected.data, count * sizeof *matches))) {
+		printf("%s: %zu indexed matches, %zu expected\n", what, count, expected.count);
+		ok = false;
+	}
+	free(expected.data);
+	return ok;
+}
+
+static bool test(const char *pattern, unsigned int seed) {
+	Text *txt = text_load(NULL);
+	Regex *r = text_regex_new();
+	if (!txt || !r || text_regex_compile(r, pattern, REG_EXTENDED)) {
+		text_regex_free(r);
+		text_free(txt);
+		return false;
+	}
+	MatchIndex *index = text_match_index_new(txt, r, 0);
+	char *contents[REVISIONS + 1] = { strdup("") };
+	for (int i = 1; i <= REVISIONS; i++) {
+		const char *f = fragments[rand_r(&seed) % (sizeof fragments / sizeof *fragments)];
+		text_insert(txt, rand_r(&seed) % (text_size(txt) + 1), f, strlen(f));
+		text_snapshot(txt);
+		contents[i] = text_bytes_alloc0(txt, 0, text_size(txt));
+	}
+	bool ok = check(txt, index, r, contents[REVISIONS], "edit");
+	for (int i = REVISIONS - 1; i >= 0; i--)
+		text_undo(txt);
+	ok &= check(txt, index, r, contents[0], "undo");
+
+	/* start a new branch, the previous one is only reachable by time */
+	text_insert(txt, 0, "ba", 2);
+	text_snapshot(txt);
+	char *branch = text_bytes_alloc0(txt, 0, text_size(txt));
+	text_earlier(txt);
+	ok &= check(txt, index, r, contents[REVISIONS], "earlier");
+	text_later(txt);
+	ok &= check(txt, index, r, branch, "later");
+	text_earlier(txt);
+	for (int i = REVISIONS - 1; i >= REVISIONS / 2; i--)
+		text_earlier(txt);
+	ok &= check(txt, index, r, contents[REVISIONS / 2], "earlier steps");
+	for (int i = 0; i <= REVISIONS; i++)
+		text_later(txt);
+	ok &= check(txt, index, r, branch, "later steps");
+
+	for (int i = 0; i <= REVISIONS; i++)
+		free(contents[i]);
+	free(branch);
+	text_match_index_free(index);
+	text_regex_free(r);
+	text_free(txt);
+	return ok;
+}
+
+int main(void) {
+	bool ok = true;
+	for (size_t i = 0; i < sizeof patterns / sizeof *patterns; i++) {
+		for (unsigned int seed = 1; seed <= 10; seed++)
+			ok &= test(patterns[i], seed);
+	}
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return !ok;
+}
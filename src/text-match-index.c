@@ -0,0 +1,265 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "text-match-index.h"
+#include "text-motions.h"
+#include "util.h"
+
+/* the matches are kept in a gap buffer sorted by position. those in front
+ * of the gap store absolute positions, those after it distances from the
+ * end of the text. changes are handled at the gap, the matches following
+ * them thus remain valid without being touched. */
+struct MatchIndex {
+	Text *txt;
+	Regex *regex;
+	int eflags;
+	RegexMatch *matches;
+	size_t size;            /* allocated number of matches */
+	size_t gap, gap_end;    /* [gap, gap_end) is unused */
+	bool stale;             /* whether the whole text has to be searched */
+	MatchIndexStats stats;
+};
+
+/* matches found while searching a window */
+typedef struct {
+	MatchIndex *index;
+	size_t end;             /* matches starting at or after end are ignored */
+	bool error;             /* memory allocation failed */
+} Collect;
+
+static size_t index_count(MatchIndex *m) {
+	return m->gap + m->size - m->gap_end;
+}
+
+/* absolute position of a match stored after the gap. while a change is
+ * handled, those within it might temporarily end up before the start */
+static size_t index_pos(size_t size, size_t dist) {
+	return dist > size ? 0 : size - dist;
+}
+
+/* the i-th match within a text of the given size */
+static RegexMatch index_at(MatchIndex *m, size_t i, size_t size) {
+	if (i < m->gap)
+		return m->matches[i];
+	RegexMatch r = m->matches[m->gap_end + i - m->gap];
+	return (RegexMatch){ .start = index_pos(size, r.start), .end = index_pos(size, r.end) };
+}
+
+/* index of the first match starting at or after pos, or if ending is set,
+ * of the first one ending after it */
+static size_t index_find(MatchIndex *m, size_t pos, size_t size, bool ending) {
+	size_t lo = 0, hi = index_count(m);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		RegexMatch r = index_at(m, mid, size);
+		if (r.start >= pos || (ending && r.end > pos))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+/* move the gap in front of the i-th match */
+static void gap_move(MatchIndex *m, size_t i, size_t size) {
+	while (m->gap > i) {
+		RegexMatch r = m->matches[--m->gap];
+		m->matches[--m->gap_end] = (RegexMatch){ .start = size - r.start, .end = size - r.end };
+	}
+	while (m->gap < i) {
+		RegexMatch r = m->matches[m->gap_end++];
+		m->matches[m->gap++] = (RegexMatch){ .start = size - r.start, .end = size - r.end };
+	}
+}
+
+static bool gap_reserve(MatchIndex *m, size_t count) {
+	if (m->gap_end - m->gap >= count)
+		return true;
+	size_t after = m->size - m->gap_end;
+	size_t size = MAX(MAX(2 * m->size, 1024), m->gap + count + after);
+	RegexMatch *matches = realloc(m->matches, size * sizeof *matches);
+	if (!matches)
+		return false;
+	memmove(&matches[size - after], &matches[m->gap_end], after * sizeof *matches);
+	m->matches = matches;
+	m->gap_end = size - after;
+	m->size = size;
+	return true;
+}
+
+static bool index_add(const RegexMatch pmatch[], size_t nmatch, void *data) {
+	Collect *c = data;
+	MatchIndex *m = c->index;
+	(void)nmatch;
+	if (pmatch[0].start >= c->end)
+		return false;
+	if (!gap_reserve(m, 1)) {
+		c->error = true;
+		return false;
+	}
+	m->matches[m->gap++] = pmatch[0];
+	return true;
+}
+
+static bool index_rebuild(MatchIndex *m) {
+	size_t size = text_size(m->txt);
+	Collect c = { .index = m, .end = EPOS };
+	m->gap = 0;
+	m->gap_end = m->size;
+	text_search_all(m->txt, 0, size, m->regex, 1, m->eflags, index_add, &c);
+	m->stale = c.error;
+	m->stats.rebuilds++;
+	m->stats.searched += size;
+	return !m->stale;
+}
+
+/* search [start, limit) for matches starting before end, storing them at
+ * the gap. limit is only beyond end if matches might span lines */
+static bool index_search(MatchIndex *m, size_t start, size_t end, size_t limit, size_t size) {
+	int eflags = m->eflags;
+	char prev;
+	if (start > 0) {
+		if ((text_regex_cflags(m->regex) & REG_NEWLINE) && text_byte_get(m->txt, start - 1, &prev) && prev == '\n')
+			eflags &= ~REG_NOTBOL;
+		else
+			eflags |= REG_NOTBOL;
+	}
+	if (limit < size)
+		eflags |= REG_NOTEOL;
+	Collect c = { .index = m, .end = end == size ? EPOS : end };
+	text_search_all(m->txt, start, limit - start, m->regex, 1, eflags, index_add, &c);
+	m->stats.searched += limit - start;
+	return !c.error;
+}
+
+/* whether a search starting after c behaves as if it continued across c,
+ * which neither belongs to a word nor to a multibyte character */
+static bool index_restart(char c) {
+	return ISASCII(c) && !isalnum((unsigned char)c) && c != '_';
+}
+
+/* position the search continues at after the match */
+static size_t index_cursor(MatchIndex *m, RegexMatch r) {
+	if (r.start != r.end)
+		return r.end;
+	char c;
+	size_t pos = r.end + 1;
+	if (text_byte_get(m->txt, r.end, &c) && (unsigned char)c >= 0xC0) {
+		while (text_byte_get(m->txt, pos, &c) && !ISUTF8(c))
+			pos++;
+	}
+	return pos;
+}
+
+/* removed bytes at pos were replaced by added ones. the matches within a
+ * window around the change are replaced by those found when searching it
+ * again. the window starts where no match can reach the change, outside
+ * of any match and after a character which does not affect the search.
+ * it ends once the old and the new matches continue the same */
+static void index_changed(void *data, size_t pos, size_t removed, size_t added) {
+	MatchIndex *m = data;
+	if (m->stale)
+		return;
+	Text *txt = m->txt;
+	size_t size = text_size(txt), old = size - added + removed;
+	size_t max = text_regex_length_max(m->regex);
+	/* a character before or after a match affects ^, $ and word boundaries */
+	size_t context = MB_CUR_MAX;
+	bool lines = text_regex_lines(m->regex);
+	size_t start, end;
+	if (lines) {
+		start = text_line_begin(txt, pos);
+		end = text_line_next(txt, pos + added);
+	} else if (max < size) {
+		start = pos > max + context ? pos - max - context : 0;
+		end = MIN(size, pos + added + max + context);
+	} else {
+		m->stale = true;
+		return;
+	}
+
+	/* the matches in front of the window are kept as is */
+	for (;;) {
+		char c;
+		while (!lines && start > 0 && !(text_byte_get(txt, start - 1, &c) && index_restart(c)))
+			start--;
+		gap_move(m, index_find(m, start, old, true), old);
+		if (m->gap_end == m->size || old - m->matches[m->gap_end].start >= start)
+			break;
+		start = old - m->matches[m->gap_end].start;
+	}
+
+	size_t gap = m->gap;
+	for (;;) {
+		size_t limit = lines ? end : MIN(size, end + max + context);
+		if (!index_search(m, start, end, limit, size)) {
+			m->stale = true;
+			return;
+		}
+		if (lines || end == size)
+			break;
+		/* unless the searches continue from the same position, the one
+		 * reaching the end of the window might find a different match */
+		size_t i = index_find(m, end, size, false);
+		size_t cur = m->gap > gap ? index_cursor(m, m->matches[m->gap-1]) : start;
+		size_t cur_old = i > m->gap ? index_cursor(m, index_at(m, i - 1, size)) : start;
+		if (cur == cur_old || MAX(cur, cur_old) < end)
+			break;
+		end = MIN(size, MAX(cur, cur_old) + 1);
+		m->gap = gap;
+	}
+
+	/* drop the old matches replaced by the ones just found */
+	if (end == size)
+		m->gap_end = m->size;
+	else
+		m->gap_end += index_find(m, end, size, false) - m->gap;
+	m->stats.updates++;
+}
+
+MatchIndex *text_match_index_new(Text *txt, Regex *regex, int eflags) {
+	MatchIndex *m = calloc(1, sizeof *m);
+	if (!m)
+		return NULL;
+	m->txt = txt;
+	m->regex = regex;
+	m->eflags = eflags;
+	/* the text is searched once the matches are needed */
+	m->stale = true;
+	if (!text_listener_add(txt, index_changed, m)) {
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+void text_match_index_free(MatchIndex *m) {
+	if (!m)
+		return;
+	text_listener_remove(m->txt, index_changed, m);
+	free(m->matches);
+	free(m);
+}
+
+const RegexMatch *text_match_index_get(MatchIndex *m, size_t pos, size_t len, size_t *count) {
+	*count = 0;
+	if (m->stale && !index_rebuild(m))
+		return NULL;
+	size_t size = text_size(m->txt), end;
+	if (!addu(pos, len, &end))
+		end = EPOS;
+	size_t first = index_find(m, pos, size, true);
+	size_t last = index_find(m, end, size, false);
+	if (first >= last)
+		return NULL;
+	gap_move(m, last, size);
+	*count = last - first;
+	return &m->matches[first];
+}
+
+MatchIndexStats text_match_index_stats(MatchIndex *m) {
+	MatchIndexStats stats = m->stats;
+	stats.matches = m->stale ? 0 : index_count(m);
+	return stats;
+}
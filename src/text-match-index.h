@@ -0,0 +1,33 @@
+#ifndef TEXT_MATCH_INDEX_H
+#define TEXT_MATCH_INDEX_H
+
+/* all non-overlapping matches of an expression within a text, kept up to
+ * date as the text is modified. after a change only the lines it touches,
+ * or a window extended by the maximal match length if matches might span
+ * lines, are searched again. matches elsewhere are merely shifted. */
+
+#include <stddef.h>
+#include "text.h"
+#include "text-regex.h"
+
+typedef struct MatchIndex MatchIndex;
+
+typedef struct {
+	size_t matches;    /* matches currently indexed */
+	size_t updates;    /* changes handled by searching a window */
+	size_t rebuilds;   /* searches of the whole text */
+	size_t searched;   /* bytes searched by the former */
+} MatchIndexStats;
+
+/* index the matches of the expression in the text and track its changes.
+ * the expression must neither be modified nor freed while the index is in
+ * use and the index has to be freed before the text */
+MatchIndex *text_match_index_new(Text*, Regex*, int eflags);
+void text_match_index_free(MatchIndex*);
+/* get the matches overlapping the range [pos, pos+len), including empty
+ * ones within it. returns NULL if there are none. the matches are only
+ * valid until the next modification or query */
+const RegexMatch *text_match_index_get(MatchIndex*, size_t pos, size_t len, size_t *count);
+MatchIndexStats text_match_index_stats(MatchIndex*);
+
+#endif
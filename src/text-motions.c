@@ -1,18 +1,29 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* memmem(3) is non-standard */
+#endif
 #include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
-#include <wchar.h>
-#include <errno.h>
 #include <limits.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include "text-motions.h"
 #include "text-util.h"
+#include "text-unicode.h"
 #include "util.h"
 #include "text-objects.h"
+#include "text-search.h"
 
 #define blank(c) ((c) == ' ' || (c) == '\t')
 #define space(c) (isspace((unsigned char)c))
 #define boundary(c) (isboundary((unsigned char)c))
 
+/* distance in bytes between column checkpoints of long lines */
+#ifndef COLUMN_CHECKPOINT
+#define COLUMN_CHECKPOINT 4096
+#endif
+
 // TODO: specify this per file type?
 int is_word_boundary(int c) {
 	return ISASCII(c) && !(('0' <= c && c <= '9') ||
@@ -20,6 +31,135 @@ int is_word_boundary(int c) {
 	         ('A' <= c && c <= 'Z') || c == '_');
 }
 
+/* byte classes used by the word motions, bytes >= 0x80 belong to none of
+ * them, i.e. non-ASCII characters are always part of a word */
+#define BYTE_SPACE    1 /* white space, isspace(3) in the C locale */
+#define BYTE_BOUNDARY 2 /* word boundary, see is_word_boundary */
+#define BYTE_ASCII    4
+
+#define S (BYTE_SPACE|BYTE_BOUNDARY|BYTE_ASCII)
+#define P (BYTE_BOUNDARY|BYTE_ASCII)
+#define W (BYTE_ASCII)
+static const unsigned char byte_class[256] = {
+	P, P, P, P, P, P, P, P, P, S, S, S, S, S, P, P,
+	P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+	S, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+	W, W, W, W, W, W, W, W, W, W, P, P, P, P, P, P,
+	P, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+	W, W, W, W, W, W, W, W, W, W, W, P, P, P, P, W,
+	P, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+	W, W, W, W, W, W, W, W, W, W, W, P, P, P, P, P,
+};
+#undef S
+#undef P
+#undef W
+
+/* run of ASCII bytes whose class masked by mask equals value */
+typedef struct {
+	unsigned char mask;
+	unsigned char value;
+} ByteRun;
+
+/* a word is either a run of non-boundary characters or one of boundary
+ * characters which are not white space */
+typedef struct {
+	unsigned char boundary; /* class delimiting words */
+	ByteRun word;           /* characters within a word */
+	ByteRun punct;          /* boundary characters other than white space */
+} WordClass;
+
+static const WordClass word = {
+	.boundary = BYTE_BOUNDARY,
+	.word = { BYTE_ASCII|BYTE_BOUNDARY, BYTE_ASCII },
+	.punct = { BYTE_ASCII|BYTE_BOUNDARY|BYTE_SPACE, BYTE_ASCII|BYTE_BOUNDARY },
+};
+
+static const WordClass longword = {
+	.boundary = BYTE_SPACE,
+	.word = { BYTE_ASCII|BYTE_SPACE, BYTE_ASCII },
+	.punct = { BYTE_ASCII, 0 }, /* never matches, all boundaries are white space */
+};
+
+static const ByteRun space_run = { BYTE_ASCII|BYTE_SPACE, BYTE_ASCII|BYTE_SPACE };
+
+#if defined(__SSE2__)
+/* bitmask of the 16 bytes starting at s which belong to the run */
+static unsigned int byte_run_mask(const unsigned char *s, const ByteRun *run) {
+	__m128i v = _mm_loadu_si128((const __m128i*)s);
+	/* signed comparisons, bytes >= 0x80 are negative and match no range */
+	#define RANGE(v, lo, hi) _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((lo)-1)), \
+		_mm_cmplt_epi8(v, _mm_set1_epi8((hi)+1)))
+	__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	__m128i space = _mm_or_si128(RANGE(v, '\t', '\r'), _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+	__m128i alnum = _mm_or_si128(RANGE(lower, 'a', 'z'), RANGE(v, '0', '9'));
+	__m128i word = _mm_or_si128(alnum, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+	#undef RANGE
+	unsigned int ascii = ~_mm_movemask_epi8(v) & 0xFFFF;
+	unsigned int mask = run->value & BYTE_ASCII ? ascii : 0;
+	if (run->mask & BYTE_SPACE) {
+		unsigned int m = _mm_movemask_epi8(space);
+		mask &= run->value & BYTE_SPACE ? m : ~m;
+	}
+	if (run->mask & BYTE_BOUNDARY) {
+		unsigned int m = ascii & ~_mm_movemask_epi8(word);
+		mask &= run->value & BYTE_BOUNDARY ? m : ~m;
+	}
+	return mask & 0xFFFF;
+}
+#endif
+
+static size_t byte_run_next(const char *str, size_t len, void *data) {
+	const ByteRun *run = data;
+	const unsigned char *s = (const unsigned char*)str, *end = s + len;
+#if defined(__SSE2__)
+	for (; end - s >= 16; s += 16) {
+		unsigned int mask = byte_run_mask(s, run);
+		if (mask != 0xFFFF)
+			return s - (const unsigned char*)str + __builtin_ctz(~mask);
+	}
+#endif
+	while (s < end && (byte_class[*s] & run->mask) == run->value)
+		s++;
+	return s - (const unsigned char*)str;
+}
+
+static size_t byte_run_prev(const char *str, size_t len, void *data) {
+	const ByteRun *run = data;
+	const unsigned char *s = (const unsigned char*)str, *end = s + len;
+#if defined(__SSE2__)
+	for (; end - s >= 16; end -= 16) {
+		unsigned int mask = byte_run_mask(end - 16, run);
+		if (mask != 0xFFFF)
+			return s + len - end + __builtin_clz(~mask << 16);
+	}
+#endif
+	while (end > s && (byte_class[end[-1]] & run->mask) == run->value)
+		end--;
+	return s + len - end;
+}
+
+/* move to the next character, skipping over a run of them first */
+static bool run_char_next(Iterator *it, char *c, const ByteRun *run) {
+	text_iterator_run_next(it, byte_run_next, (void*)run);
+	return text_iterator_char_next(it, c);
+}
+
+static bool run_char_prev(Iterator *it, char *c, const ByteRun *run) {
+	text_iterator_run_prev(it, byte_run_prev, (void*)run);
+	return text_iterator_char_prev(it, c);
+}
+
+/* repeat a motion count times, stopping early once it no longer moves */
+static size_t motion_n(Text *txt, size_t pos, size_t count, size_t (*motion)(Text*, size_t)) {
+	while (count-- > 0) {
+		size_t newpos = motion(txt, pos);
+		if (newpos == pos)
+			break;
+		pos = newpos;
+	}
+	return pos;
+}
+
 size_t text_begin(Text *txt, size_t pos) {
 	return 0;
 }
@@ -40,6 +180,44 @@ size_t text_char_prev(Text *txt, size_t pos) {
 	return it.pos;
 }
 
+size_t text_char_next_n(Text *txt, size_t pos, size_t count) {
+	/* every ASCII byte is a character of its own, except that the last one
+	 * might be followed by combining marks */
+	if (count > 1 && count <= text_size(txt) - pos && text_profile_ascii(txt, pos, count)) {
+		pos += count - 1;
+		count = 1;
+	}
+	Iterator it = text_iterator_get(txt, pos);
+	while (count > 0) {
+		size_t ascii = text_iterator_ascii_next(&it, count);
+		count -= ascii;
+		if (ascii)
+			continue;
+		size_t prev = it.pos;
+		if (!text_iterator_char_next(&it, NULL)) {
+			if (it.pos == prev)
+				break;
+			/* continue like a subsequent text_char_next call would */
+			it = text_iterator_get(txt, it.pos);
+		}
+		count--;
+	}
+	return it.pos;
+}
+
+size_t text_char_prev_n(Text *txt, size_t pos, size_t count) {
+	Iterator it = text_iterator_get(txt, pos);
+	for (; count > 0; count--) {
+		size_t prev = it.pos;
+		if (!text_iterator_char_prev(&it, NULL)) {
+			if (it.pos == prev)
+				break;
+			it = text_iterator_get(txt, it.pos);
+		}
+	}
+	return it.pos;
+}
+
 size_t text_codepoint_next(Text *txt, size_t pos) {
 	Iterator it = text_iterator_get(txt, pos);
 	text_iterator_codepoint_next(&it, NULL);
@@ -52,65 +230,235 @@ size_t text_codepoint_prev(Text *txt, size_t pos) {
 	return it.pos;
 }
 
-static size_t find_next(Text *txt, size_t pos, const char *s, bool line) {
-	if (!s)
-		return pos;
-	size_t len = strlen(s), matched = 0;
-	Iterator it = text_iterator_get(txt, pos), sit;
-	for (char c; matched < len && text_iterator_byte_get(&it, &c); ) {
-		if (c == s[matched]) {
-			if (matched == 0)
-				sit = it;
-			matched++;
-		} else if (matched > 0) {
-			it = sit;
-			matched = 0;
+/* literal substring search. every contiguous part of the text is searched
+ * directly using the Two-Way algorithm which runs in linear time and constant
+ * space, occurrences straddling piece boundaries are found by searching a
+ * window of at most 2*(len-1) bytes around each boundary. backward searches
+ * run the same algorithm with the needle and the haystack reversed. */
+typedef struct {
+	unsigned char fold[256];  /* mapping applied to each byte before comparison */
+	size_t shift[256];        /* 1 + offset of the last occurrence of a byte in the needle */
+	unsigned char *needle;    /* folded needle, reversed for backward searches */
+	char *window;             /* bytes around a piece boundary */
+	size_t len;
+	size_t ms;                /* critical factorization position */
+	size_t period;
+	size_t mem0;              /* bytes known to match after shifting by the period */
+	bool backward;
+	bool exact;               /* forward search without folding, use memmem(3) */
+} Finder;
+
+/* maximal suffix of the needle with respect to the given ordering */
+static size_t finder_suffix(const unsigned char *n, size_t l, bool greater, size_t *period) {
+	size_t ip = -1, jp = 0, k = 1, p = 1;
+	while (jp + k < l) {
+		unsigned char a = n[ip+k], b = n[jp+k];
+		if (a == b) {
+			if (k == p) {
+				jp += p;
+				k = 1;
+			} else {
+				k++;
+			}
+		} else if (greater ? a > b : a < b) {
+			jp += k;
+			k = 1;
+			p = jp - ip;
+		} else {
+			ip = jp++;
+			k = p = 1;
 		}
-		text_iterator_byte_next(&it, NULL);
-		if (line && c == '\n')
+	}
+	*period = p;
+	return ip;
+}
+
+static bool finder_init(Finder *f, const char *s, size_t len, bool icase, bool backward) {
+	f->needle = malloc(3*len);
+	if (!f->needle)
+		return false;
+	f->window = (char*)f->needle + len;
+	f->len = len;
+	f->backward = backward;
+	f->exact = !icase && !backward;
+	for (int c = 0; c < 256; c++)
+		f->fold[c] = icase && 'A' <= c && c <= 'Z' ? c - 'A' + 'a' : c;
+	memset(f->shift, 0, sizeof f->shift);
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = f->fold[(unsigned char)s[backward ? len - 1 - i : i]];
+		f->needle[i] = c;
+		f->shift[c] = i + 1;
+	}
+
+	/* critical factorization, the later of the two maximal suffixes */
+	size_t p0, p1;
+	size_t ms0 = finder_suffix(f->needle, len, true, &p0);
+	size_t ms1 = finder_suffix(f->needle, len, false, &p1);
+	bool first = ms0 + 1 >= ms1 + 1;
+	f->ms = first ? ms0 : ms1;
+	f->period = first ? p0 : p1;
+	if (memcmp(f->needle, f->needle + f->period, f->ms + 1)) {
+		f->mem0 = 0;
+		f->period = MAX(f->ms, len - f->ms - 1) + 1;
+	} else {
+		f->mem0 = len - f->period;
+	}
+	return true;
+}
+
+static void finder_free(Finder *f) {
+	free(f->needle);
+}
+
+/* offset of the first occurrence of the needle in s[0..n), the last one for
+ * backward searches, or EPOS if there is none */
+static size_t finder_search(const Finder *f, const char *s, size_t n) {
+	size_t l = f->len;
+	if (n < l)
+		return EPOS;
+	if (f->exact) {
+		const char *match = memmem(s, n, f->needle, l);
+		return match ? (size_t)(match - s) : EPOS;
+	}
+	/* i-th byte of the (reversed) haystack */
+	#define BYTE(i) (f->fold[(unsigned char)s[f->backward ? n - 1 - (i) : (i)]])
+	const unsigned char *needle = f->needle;
+	size_t ms = f->ms, mem = 0, k;
+	for (size_t h = 0; n - h >= l; ) {
+		size_t shift = f->shift[BYTE(h + l - 1)];
+		if (shift != l) {
+			/* align the last occurrence of this byte in the needle */
+			k = shift ? l - shift : l;
+			h += MAX(k, mem);
+			mem = 0;
+			continue;
+		}
+		for (k = MAX(ms + 1, mem); k < l && needle[k] == BYTE(h + k); k++);
+		if (k < l) {
+			h += k - ms;
+			mem = 0;
+			continue;
+		}
+		for (k = ms + 1; k > mem && needle[k-1] == BYTE(h + k - 1); k--);
+		if (k <= mem)
+			return f->backward ? n - h - l : h;
+		h += f->period;
+		mem = f->mem0;
+	}
+	#undef BYTE
+	return EPOS;
+}
+
+/* search the occurrences straddling the piece boundary at the iterator
+ * position, considering at most before/after bytes on either side */
+static size_t finder_boundary(Finder *f, const Iterator *it, size_t before, size_t after) {
+	char *w = f->window;
+	size_t rem = before;
+	for (Iterator p = *it; rem > 0; ) {
+		size_t n = MIN(rem, (size_t)(p.text - p.start));
+		memcpy(w + rem - n, p.text - n, n);
+		rem -= n;
+		if (rem > 0 && !text_iterator_prev(&p))
+			return EPOS;
+	}
+	size_t len = before;
+	for (Iterator p = *it; len < before + after; ) {
+		size_t n = MIN(before + after - len, (size_t)(p.end - p.text));
+		memcpy(w + len, p.text, n);
+		len += n;
+		if (len < before + after && !text_iterator_next(&p))
 			break;
 	}
-	return matched == len ? it.pos - len : pos;
+	size_t off = finder_search(f, w, len);
+	if (off == EPOS || off >= before || off + f->len <= before)
+		return EPOS;
+	return it->pos - before + off;
+}
+
+static size_t find_next(Text *txt, size_t pos, const char *s, bool line, bool icase) {
+	if (!s || !*s)
+		return pos;
+	size_t end = text_size(txt);
+	if (line) {
+		Iterator it = text_iterator_get(txt, pos);
+		if (text_iterator_byte_find_next(&it, '\n'))
+			end = it.pos + 1;
+	}
+	Finder f;
+	if (!finder_init(&f, s, strlen(s), icase, false))
+		return pos;
+	size_t keep = f.len - 1, match = EPOS;
+	for (Iterator it = text_iterator_get(txt, pos);
+	     match == EPOS && text_iterator_valid(&it) && it.pos < end;
+	     text_iterator_next(&it)) {
+		size_t len = MIN((size_t)(it.end - it.text), end - it.pos);
+		if (len == 0)
+			continue;
+		if (keep && it.pos > pos)
+			match = finder_boundary(&f, &it, MIN(keep, it.pos - pos), MIN(keep, end - it.pos));
+		if (match == EPOS) {
+			size_t off = finder_search(&f, it.text, len);
+			if (off != EPOS)
+				match = it.pos + off;
+		}
+	}
+	finder_free(&f);
+	return match == EPOS ? pos : match;
 }
 
 size_t text_find_next(Text *txt, size_t pos, const char *s) {
-	return find_next(txt, pos, s, false);
+	return find_next(txt, pos, s, false, false);
+}
+
+size_t text_find_next_icase(Text *txt, size_t pos, const char *s) {
+	return find_next(txt, pos, s, false, true);
 }
 
 size_t text_line_find_next(Text *txt, size_t pos, const char *s) {
-	return find_next(txt, pos, s, true);
+	return find_next(txt, pos, s, true, false);
 }
 
-static size_t find_prev(Text *txt, size_t pos, const char *s, bool line) {
-	if (!s)
+static size_t find_prev(Text *txt, size_t pos, const char *s, bool line, bool icase) {
+	if (!s || !*s)
 		return pos;
-	size_t len = strlen(s), matched = len - 1;
-	Iterator it = text_iterator_get(txt, pos), sit;
-	if (len == 0)
+	size_t start = 0;
+	if (line) {
+		Iterator it = text_iterator_get(txt, pos);
+		if (text_iterator_byte_find_prev(&it, '\n'))
+			start = it.pos;
+	}
+	Finder f;
+	if (!finder_init(&f, s, strlen(s), icase, true))
 		return pos;
-	for (char c; text_iterator_byte_prev(&it, &c); ) {
-		if (c == s[matched]) {
-			if (matched == 0)
-				return it.pos;
-			if (matched == len - 1)
-				sit = it;
-			matched--;
-		} else if (matched < len - 1) {
-			it = sit;
-			matched = len - 1;
+	size_t keep = f.len - 1, match = EPOS;
+	for (Iterator it = text_iterator_get(txt, pos);
+	     match == EPOS && text_iterator_valid(&it) && it.pos > start;
+	     text_iterator_prev(&it)) {
+		size_t len = MIN((size_t)(it.text - it.start), it.pos - start);
+		if (len == 0)
+			continue;
+		if (keep && it.pos < pos)
+			match = finder_boundary(&f, &it, MIN(keep, it.pos - start), MIN(keep, pos - it.pos));
+		if (match == EPOS) {
+			size_t off = finder_search(&f, it.text - len, len);
+			if (off != EPOS)
+				match = it.pos - len + off;
 		}
-		if (line && c == '\n')
-			break;
 	}
-	return pos;
+	finder_free(&f);
+	return match == EPOS ? pos : match;
 }
 
 size_t text_find_prev(Text *txt, size_t pos, const char *s) {
-	return find_prev(txt, pos, s, false);
+	return find_prev(txt, pos, s, false, false);
+}
+
+size_t text_find_prev_icase(Text *txt, size_t pos, const char *s) {
+	return find_prev(txt, pos, s, false, true);
 }
 
 size_t text_line_find_prev(Text *txt, size_t pos, const char *s) {
-	return find_prev(txt, pos, s, true);
+	return find_prev(txt, pos, s, true, false);
 }
 
 size_t text_line_prev(Text *txt, size_t pos) {
@@ -120,6 +468,9 @@ size_t text_line_prev(Text *txt, size_t pos) {
 }
 
 size_t text_line_begin(Text *txt, size_t pos) {
+	size_t bol = text_columns_line_begin(txt, pos);
+	if (bol != EPOS)
+		return bol;
 	Iterator it = text_iterator_get(txt, pos);
 	return text_iterator_byte_find_prev(&it, '\n') ? it.pos+1 : it.pos;
 }
@@ -164,101 +515,223 @@ size_t text_line_offset(Text *txt, size_t pos, size_t off) {
 	return it.pos;
 }
 
+/* number of leading checkpoints at or before pos with a column of at most value */
+static size_t column_find(const TextColumn *cols, size_t count, size_t pos, int value) {
+	size_t lo = 0, hi = count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (cols[mid].pos <= pos && cols[mid].value <= value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* position after which the next checkpoint of a line is recorded */
+static size_t column_next(const TextColumn *cols, size_t count, size_t bol) {
+	return (count ? cols[count-1].pos : bol) + COLUMN_CHECKPOINT;
+}
+
 size_t text_line_char_set(Text *txt, size_t pos, int count) {
 	char c;
-	size_t bol = text_line_begin(txt, pos);
-	Iterator it = text_iterator_get(txt, bol);
-	if (text_iterator_byte_get(&it, &c) && c != '\n')
-		while (count-- > 0 && text_iterator_char_next(&it, &c) && c != '\n');
+	size_t bol = text_line_begin(txt, pos), n;
+	const TextColumn *cols = text_columns_get(txt, bol, TEXT_COLUMN_CHARS, &n);
+	size_t next = column_next(cols, n, bol);
+	size_t i = column_find(cols, n, SIZE_MAX, count);
+	Iterator it = text_iterator_get(txt, i ? cols[i-1].pos : bol);
+	count -= i ? cols[i-1].value : 0;
+	int value = i ? cols[i-1].value : 0;
+	if (text_iterator_byte_get(&it, &c) && c != '\n') {
+		while (count > 0) {
+			size_t max = MIN((size_t)count, next - it.pos);
+			size_t ascii = text_iterator_ascii_next(&it, max);
+			count -= ascii;
+			value += ascii;
+			if (!ascii) {
+				if (!text_iterator_char_next(&it, &c) || c == '\n')
+					break;
+				count--;
+				value++;
+			}
+			if (it.pos >= next) {
+				text_columns_add(txt, bol, TEXT_COLUMN_CHARS, it.pos, value);
+				next = it.pos + COLUMN_CHECKPOINT;
+			}
+		}
+	}
 	return it.pos;
 }
 
 int text_line_char_get(Text *txt, size_t pos) {
 	char c;
-	int count = 0;
-	size_t bol = text_line_begin(txt, pos);
-	Iterator it = text_iterator_get(txt, bol);
+	size_t bol = text_line_begin(txt, pos), n;
+	if (pos - bol <= INT_MAX && text_profile_ascii(txt, bol, pos - bol))
+		return pos - bol;
+	const TextColumn *cols = text_columns_get(txt, bol, TEXT_COLUMN_CHARS, &n);
+	size_t next = column_next(cols, n, bol);
+	size_t i = column_find(cols, n, pos, INT_MAX);
+	Iterator it = text_iterator_get(txt, i ? cols[i-1].pos : bol);
+	int count = i ? cols[i-1].value : 0;
 	if (text_iterator_byte_get(&it, &c) && c != '\n') {
-		while (it.pos < pos && c != '\n' && text_iterator_char_next(&it, &c))
-			count++;
+		while (it.pos < pos && c != '\n') {
+			/* skipped characters are printable, thus never a newline */
+			size_t max = MIN(pos, next) - it.pos;
+			size_t ascii = text_iterator_ascii_next(&it, max);
+			count += ascii;
+			if (!ascii) {
+				if (!text_iterator_char_next(&it, &c))
+					break;
+				count++;
+			}
+			if (it.pos >= next && c != '\n') {
+				text_columns_add(txt, bol, TEXT_COLUMN_CHARS, it.pos, count);
+				next = it.pos + COLUMN_CHECKPOINT;
+			}
+		}
 	}
 	return count;
 }
 
-int text_line_width_get(Text *txt, size_t pos) {
-	int width = 0;
-	mbstate_t ps = { 0 };
-	size_t bol = text_line_begin(txt, pos);
-	Iterator it = text_iterator_get(txt, bol);
+/* state of a display width computation, fed piece by piece via text_iterate */
+typedef struct {
+	Text *txt;        /* text to record column checkpoints in */
+	size_t bol;       /* start of the line, always decoded as a character */
+	size_t pos;       /* absolute position of the next byte to consume */
+	size_t end;       /* stop at the first character starting at or after it */
+	int limit;        /* stop once the width reaches this value */
+	int width;        /* accumulated display width */
+	size_t start;     /* start of the character currently being decoded */
+	char seq[UTF8_LEN_MAX]; /* sequence straddling a piece boundary */
+	size_t seq_len;   /* its length, zero if none is pending */
+	size_t next;      /* record a checkpoint at the first character starting at or after it */
+} LineWidth;
+
+static void line_width_checkpoint(LineWidth *lw, size_t pos, int width) {
+	text_columns_add(lw->txt, lw->bol, TEXT_COLUMN_WIDTH, pos, width);
+	lw->next = pos + COLUMN_CHECKPOINT;
+}
 
-	while (it.pos < pos) {
-		char buf[MB_LEN_MAX];
-		size_t len = text_bytes_get(txt, it.pos, sizeof buf, buf);
-		if (len == 0 || buf[0] == '\n')
-			break;
-		wchar_t wc;
-		size_t wclen = mbrtowc(&wc, buf, len, &ps);
-		if (wclen == (size_t)-1 && errno == EILSEQ) {
-			ps = (mbstate_t){0};
+static bool line_width_visit(const TextString *str, void *data) {
+	LineWidth *lw = data;
+	const char *s = str->data, *end = s + str->len;
+	size_t base = lw->pos;
+
+	while (s < end) {
+		const char *c = s;
+		size_t len = end - s, prefix = lw->seq_len;
+		if (prefix) {
+			/* complete the sequence started in a previous piece */
+			size_t n = MIN(sizeof(lw->seq) - prefix, len);
+			memcpy(lw->seq + prefix, s, n);
+			c = lw->seq;
+			len = prefix + n;
+		} else {
+			size_t start = base + (s - str->data);
+			if (!ISUTF8(*s) && start != lw->bol) {
+				s++;
+				continue;
+			}
+			lw->start = start;
+			if (lw->start >= lw->end || *s == '\n')
+				goto stop;
+			if (start >= lw->next)
+				line_width_checkpoint(lw, start, lw->width);
+			size_t ascii = text_ascii_span(s, MIN(len, lw->end - start));
+			if (ascii) {
+				/* every byte of the run starts a character */
+				while (lw->next < start + ascii)
+					line_width_checkpoint(lw, lw->next, lw->width + (lw->next - start));
+				/* printable ASCII, each character has width 1 */
+				if (lw->width >= lw->limit || ascii >= (size_t)(lw->limit - lw->width)) {
+					size_t n = lw->width < lw->limit ? lw->limit - lw->width : 1;
+					lw->start += n - 1;
+					lw->width += n;
+					goto stop;
+				}
+				lw->width += ascii;
+				s += ascii;
+				continue;
+			}
+			if (*s == '\t') {
+				s++;
+				lw->width++;
+				goto next;
+			}
+		}
+
+		uint32_t cp;
+		size_t clen = text_utf8_decode(&cp, c, len);
+		lw->seq_len = 0;
+		if (clen == (size_t)-1) {
 			/* assume a replacement symbol will be displayed */
-			width++;
-		} else if (wclen == (size_t)-2) {
-			/* do nothing, advance to next character */
-		} else if (wclen == 0) {
+			lw->width++;
+			if (!prefix)
+				s++;
+		} else if (clen == (size_t)-2) {
+			/* sequence continues in the next piece */
+			memmove(lw->seq, c, len);
+			lw->seq_len = len;
+			break;
+		} else if (clen == 0) {
 			/* assume NUL byte will be displayed as ^@ */
-			width += 2;
-		} else if (buf[0] == '\t') {
-			width++;
+			lw->width += 2;
+			s++;
 		} else {
-			int w = wcwidth(wc);
+			int w = text_unicode_width(cp);
 			if (w == -1)
 				w = 2; /* assume non-printable will be displayed as ^{char} */
-			width += w;
+			lw->width += w;
+			s += clen - prefix;
 		}
+next:
+		if (lw->width >= lw->limit)
+			goto stop;
+	}
 
-		if (!text_iterator_codepoint_next(&it, NULL))
-			break;
+	lw->pos = base + str->len;
+	return true;
+stop:
+	lw->pos = lw->start;
+	lw->end = 0;
+	return false;
+}
+
+/* walk the line containing pos, stopping at the first character starting at
+ * or after end, or once the display width reaches limit. returns the start
+ * of the character where the walk stopped, or the end of the text */
+static size_t line_width_walk(Text *txt, size_t pos, size_t end, int limit, int *width) {
+	size_t bol = text_line_begin(txt, pos), n;
+	const TextColumn *cols = text_columns_get(txt, bol, TEXT_COLUMN_WIDTH, &n);
+	LineWidth lw = {
+		.txt = txt, .bol = bol, .pos = bol, .end = end, .limit = limit,
+		.next = column_next(cols, n, bol),
+	};
+	/* resume from the last checkpoint the walk would pass */
+	size_t i = limit > 0 ? column_find(cols, n, end, limit - 1) : 0;
+	if (i) {
+		lw.pos = cols[i-1].pos;
+		lw.width = cols[i-1].value;
 	}
+	/* a character starting before end may extend past it */
+	size_t len = end < SIZE_MAX - UTF8_LEN_MAX ? end + UTF8_LEN_MAX - lw.pos : SIZE_MAX;
+	text_iterate(txt, lw.pos, len, line_width_visit, &lw);
+	/* a sequence truncated by the end of the text counts as a character */
+	if (lw.seq_len && lw.width >= limit)
+		lw.pos = lw.start;
+	if (width)
+		*width = lw.width;
+	return lw.pos;
+}
 
+int text_line_width_get(Text *txt, size_t pos) {
+	int width;
+	line_width_walk(txt, pos, pos, INT_MAX, &width);
 	return width;
 }
 
 size_t text_line_width_set(Text *txt, size_t pos, int width) {
-	int cur_width = 0;
-	mbstate_t ps = { 0 };
-	size_t bol = text_line_begin(txt, pos);
-	Iterator it = text_iterator_get(txt, bol);
-
-	for (;;) {
-		char buf[MB_LEN_MAX];
-		size_t len = text_bytes_get(txt, it.pos, sizeof buf, buf);
-		if (len == 0 || buf[0] == '\n')
-			break;
-		wchar_t wc;
-		size_t wclen = mbrtowc(&wc, buf, len, &ps);
-		if (wclen == (size_t)-1 && errno == EILSEQ) {
-			ps = (mbstate_t){0};
-			/* assume a replacement symbol will be displayed */
-			cur_width++;
-		} else if (wclen == (size_t)-2) {
-			/* do nothing, advance to next character */
-		} else if (wclen == 0) {
-			/* assume NUL byte will be displayed as ^@ */
-			cur_width += 2;
-		} else if (buf[0] == '\t') {
-			cur_width++;
-		} else {
-			int w = wcwidth(wc);
-			if (w == -1)
-				w = 2; /* assume non-printable will be displayed as ^{char} */
-			cur_width += w;
-		}
-
-		if (cur_width >= width || !text_iterator_codepoint_next(&it, NULL))
-			break;
-	}
-
-	return it.pos;
+	return line_width_walk(txt, pos, SIZE_MAX, width, NULL);
 }
 
 size_t text_line_char_next(Text *txt, size_t pos) {
@@ -290,6 +763,29 @@ size_t text_line_down(Text *txt, size_t pos) {
 	return text_line_width_set(txt, next, width);
 }
 
+size_t text_line_prev_n(Text *txt, size_t pos, size_t count) {
+	size_t lineno = text_lineno_by_pos(txt, pos);
+	return text_pos_by_lineno(txt, lineno > count ? lineno - count : 1);
+}
+
+size_t text_line_next_n(Text *txt, size_t pos, size_t count) {
+	size_t lineno = text_lineno_by_pos(txt, pos);
+	size_t bol = count < SIZE_MAX - lineno ? text_pos_by_lineno(txt, lineno + count) : EPOS;
+	return bol != EPOS ? bol : text_line_begin(txt, text_size(txt));
+}
+
+size_t text_line_up_n(Text *txt, size_t pos, size_t count) {
+	int width = text_line_width_get(txt, pos);
+	size_t prev = text_line_prev_n(txt, pos, count);
+	return text_line_width_set(txt, prev, width);
+}
+
+size_t text_line_down_n(Text *txt, size_t pos, size_t count) {
+	int width = text_line_width_get(txt, pos);
+	size_t next = text_line_next_n(txt, pos, count);
+	return text_line_width_set(txt, next, width);
+}
+
 size_t text_range_line_first(Text *txt, Filerange *r) {
 	if (!text_range_valid(r))
 		return EPOS;
@@ -322,7 +818,83 @@ size_t text_range_line_prev(Text *txt, Filerange *r, size_t pos) {
 	return newpos != pos && r->start <= newpos ? newpos : EPOS;
 }
 
+#define class_boundary(c) (byte_class[(unsigned char)(c)] & w->boundary)
+#define class_space(c) (byte_class[(unsigned char)(c)] & BYTE_SPACE)
+#define class_punct(c) (class_boundary(c) && !class_space(c))
+
+static size_t word_start_next(Text *txt, size_t pos, const WordClass *w) {
+	char c;
+	Iterator it = text_iterator_get(txt, pos);
+	if (!text_iterator_byte_get(&it, &c))
+		return pos;
+	if (class_boundary(c))
+		while (class_punct(c) && run_char_next(&it, &c, &w->punct));
+	else
+		while (!class_boundary(c) && run_char_next(&it, &c, &w->word));
+	while (class_space(c) && run_char_next(&it, &c, &space_run));
+	return it.pos;
+}
+
+static size_t word_start_prev(Text *txt, size_t pos, const WordClass *w) {
+	char c = '\0';
+	Iterator it = text_iterator_get(txt, pos);
+	while (run_char_prev(&it, &c, &space_run) && class_space(c));
+	if (class_boundary(c))
+		do {
+			text_iterator_run_prev(&it, byte_run_prev, (void*)&w->punct);
+			pos = it.pos;
+		} while (text_iterator_char_prev(&it, &c) && class_punct(c));
+	else
+		do {
+			text_iterator_run_prev(&it, byte_run_prev, (void*)&w->word);
+			pos = it.pos;
+		} while (text_iterator_char_prev(&it, &c) && !class_boundary(c));
+	return pos;
+}
+
+static size_t word_end_next(Text *txt, size_t pos, const WordClass *w) {
+	char c = '\0';
+	Iterator it = text_iterator_get(txt, pos);
+	while (run_char_next(&it, &c, &space_run) && class_space(c));
+	if (class_boundary(c))
+		do {
+			text_iterator_run_next(&it, byte_run_next, (void*)&w->punct);
+			pos = it.pos;
+		} while (text_iterator_char_next(&it, &c) && class_punct(c));
+	else
+		do {
+			text_iterator_run_next(&it, byte_run_next, (void*)&w->word);
+			pos = it.pos;
+		} while (text_iterator_char_next(&it, &c) && !class_boundary(c));
+	return pos;
+}
+
+static size_t word_end_prev(Text *txt, size_t pos, const WordClass *w) {
+	char c;
+	Iterator it = text_iterator_get(txt, pos);
+	if (!text_iterator_byte_get(&it, &c))
+		return pos;
+	if (class_boundary(c))
+		while (class_punct(c) && run_char_prev(&it, &c, &w->punct));
+	else
+		while (!class_boundary(c) && run_char_prev(&it, &c, &w->word));
+	while (class_space(c) && run_char_prev(&it, &c, &space_run));
+	return it.pos;
+}
+
+/* the predefined boundaries are handled by the byte class based versions */
+static const WordClass *word_class(int (*isboundary)(int)) {
+	if (isboundary == is_word_boundary)
+		return &word;
+	if (isboundary == isspace)
+		return &longword;
+	return NULL;
+}
+
 size_t text_customword_start_next(Text *txt, size_t pos, int (*isboundary)(int)) {
+	const WordClass *w = word_class(isboundary);
+	if (w)
+		return word_start_next(txt, pos, w);
 	char c;
 	Iterator it = text_iterator_get(txt, pos);
 	if (!text_iterator_byte_get(&it, &c))
@@ -336,6 +908,9 @@ size_t text_customword_start_next(Text *txt, size_t pos, int (*isboundary)(int))
 }
 
 size_t text_customword_start_prev(Text *txt, size_t pos, int (*isboundary)(int)) {
+	const WordClass *w = word_class(isboundary);
+	if (w)
+		return word_start_prev(txt, pos, w);
 	char c;
 	Iterator it = text_iterator_get(txt, pos);
 	while (text_iterator_char_prev(&it, &c) && space(c));
@@ -347,6 +922,9 @@ size_t text_customword_start_prev(Text *txt, size_t pos, int (*isboundary)(int))
 }
 
 size_t text_customword_end_next(Text *txt, size_t pos, int (*isboundary)(int)) {
+	const WordClass *w = word_class(isboundary);
+	if (w)
+		return word_end_next(txt, pos, w);
 	char c;
 	Iterator it = text_iterator_get(txt, pos);
 	while (text_iterator_char_next(&it, &c) && space(c));
@@ -358,6 +936,9 @@ size_t text_customword_end_next(Text *txt, size_t pos, int (*isboundary)(int)) {
 }
 
 size_t text_customword_end_prev(Text *txt, size_t pos, int (*isboundary)(int)) {
+	const WordClass *w = word_class(isboundary);
+	if (w)
+		return word_end_prev(txt, pos, w);
 	char c;
 	Iterator it = text_iterator_get(txt, pos);
 	if (!text_iterator_byte_get(&it, &c))
@@ -371,35 +952,67 @@ size_t text_customword_end_prev(Text *txt, size_t pos, int (*isboundary)(int)) {
 }
 
 size_t text_longword_end_next(Text *txt, size_t pos) {
-	return text_customword_end_next(txt, pos, isspace);
+	return word_end_next(txt, pos, &longword);
 }
 
 size_t text_longword_end_prev(Text *txt, size_t pos) {
-	return text_customword_end_prev(txt, pos, isspace);
+	return word_end_prev(txt, pos, &longword);
 }
 
 size_t text_longword_start_next(Text *txt, size_t pos) {
-	return text_customword_start_next(txt, pos, isspace);
+	return word_start_next(txt, pos, &longword);
 }
 
 size_t text_longword_start_prev(Text *txt, size_t pos) {
-	return text_customword_start_prev(txt, pos, isspace);
+	return word_start_prev(txt, pos, &longword);
 }
 
 size_t text_word_end_next(Text *txt, size_t pos) {
-	return text_customword_end_next(txt, pos, is_word_boundary);
+	return word_end_next(txt, pos, &word);
 }
 
 size_t text_word_end_prev(Text *txt, size_t pos) {
-	return text_customword_end_prev(txt, pos, is_word_boundary);
+	return word_end_prev(txt, pos, &word);
 }
 
 size_t text_word_start_next(Text *txt, size_t pos) {
-	return text_customword_start_next(txt, pos, is_word_boundary);
+	return word_start_next(txt, pos, &word);
 }
 
 size_t text_word_start_prev(Text *txt, size_t pos) {
-	return text_customword_start_prev(txt, pos, is_word_boundary);
+	return word_start_prev(txt, pos, &word);
+}
+
+size_t text_longword_end_next_n(Text *txt, size_t pos, size_t count) {
+	return motion_n(txt, pos, count, text_longword_end_next);
+}
+
+size_t text_longword_end_prev_n(Text *txt, size_t pos, size_t count) {
+	return motion_n(txt, pos, count, text_longword_end_prev);
+}
+
+size_t text_longword_start_next_n(Text *txt, size_t pos, size_t count) {
+	return motion_n(txt, pos, count, text_longword_start_next);
+}
+
+size_t text_longword_start_prev_n(Text *txt, size_t pos, size_t count) {
+	return motion_n(txt, pos, count, text_longword_start_prev);
+}
+
+size_t text_word_end_next_n(Text *txt, size_t pos, size_t count) {
+	return motion_n(txt, pos, count, text_word_end_next);
+}
+
+size_t text_word_end_prev_n(Text *txt, size_t pos, size_t count) {
+	return motion_n(txt, pos, count, text_word_end_prev);
+}
+
+size_t text_word_start_next_n(Text *txt, size_t pos, size_t count) {
+	return motion_n(txt, pos, count, text_word_start_next);
+}
+
+size_t text_word_start_prev_n(Text *txt, size_t pos, size_t count) {
+	return motion_n(txt, pos, count, text_word_start_prev);
 }
 
 size_t text_sentence_next(Text *txt, size_t pos) {
@@ -461,8 +1074,48 @@ size_t text_paragraph_prev(Text *txt, size_t pos) {
 	return text_line_blank_prev(txt, it.pos);
 }
 
+size_t text_paragraph_next_n(Text *txt, size_t pos, size_t count) {
+	return motion_n(txt, pos, count, text_paragraph_next);
+}
+
+size_t text_paragraph_prev_n(Text *txt, size_t pos, size_t count) {
+	return motion_n(txt, pos, count, text_paragraph_prev);
+}
+
+/* find the start of the next line after pos which is empty (or blank) and
+ * terminated by a new line, using the line metadata table. returns EPOS if
+ * the table is not available */
+static size_t line_info_next(Text *txt, size_t pos, bool blank) {
+	TextLineInfo info;
+	size_t size = text_size(txt);
+	for (size_t bol = text_line_next(txt, pos); bol < size; bol += info.len + 1) {
+		if (!text_line_info(txt, bol, &info))
+			return EPOS;
+		if ((blank ? info.blank : info.empty) && bol + info.len < size)
+			return bol;
+	}
+	return size;
+}
+
+/* find the start of the previous line before pos which is empty (or blank),
+ * using the line metadata table. returns EPOS if it is not available */
+static size_t line_info_prev(Text *txt, size_t pos, bool blank) {
+	TextLineInfo info;
+	for (size_t bol = text_line_begin(txt, pos); bol > 0; ) {
+		if (!text_line_info(txt, bol - 1, &info))
+			return EPOS;
+		bol -= info.len + 1;
+		if (blank ? info.blank : info.empty)
+			return bol;
+	}
+	return 0;
+}
+
 size_t text_line_empty_next(Text *txt, size_t pos) {
 	char c;
+	size_t next = line_info_next(txt, pos, false);
+	if (next != EPOS)
+		return next;
 	Iterator it = text_iterator_get(txt, pos);
 	while (text_iterator_byte_find_next(&it, '\n')) {
 		if (text_iterator_byte_next(&it, &c) && c == '\n')
@@ -473,6 +1126,9 @@ size_t text_line_empty_next(Text *txt, size_t pos) {
 
 size_t text_line_empty_prev(Text *txt, size_t pos) {
 	char c;
+	size_t prev = line_info_prev(txt, pos, false);
+	if (prev != EPOS)
+		return prev;
 	Iterator it = text_iterator_get(txt, pos);
 	while (text_iterator_byte_find_prev(&it, '\n')) {
 		if (text_iterator_byte_prev(&it, &c) && c == '\n')
@@ -483,6 +1139,9 @@ size_t text_line_empty_prev(Text *txt, size_t pos) {
 
 size_t text_line_blank_next(Text *txt, size_t pos) {
 	char c;
+	size_t next = line_info_next(txt, pos, true);
+	if (next != EPOS)
+		return next;
 	Iterator it = text_iterator_get(txt, pos);
 	while (text_iterator_byte_find_next(&it, '\n')) {
 		size_t n = it.pos;
@@ -494,7 +1153,10 @@ size_t text_line_blank_next(Text *txt, size_t pos) {
 }
 
 size_t text_line_blank_prev(Text *txt, size_t pos) {
-	char c;
+	char c = '\0';
+	size_t prev = line_info_prev(txt, pos, true);
+	if (prev != EPOS)
+		return prev;
 	Iterator it = text_iterator_get(txt, pos);
 	while (text_iterator_byte_find_prev(&it, '\n')) {
 		while (text_iterator_byte_prev(&it, &c) && blank(c));
@@ -618,12 +1280,12 @@ size_t text_search_forward(Text *txt, size_t pos, Regex *regex) {
 	size_t start = pos + 1;
 	size_t end = text_size(txt);
 	RegexMatch match[1];
-	bool found = start < end && !text_search_range_forward(txt, start, end - start, regex, 1, match, 0);
+	bool found = start < end && !text_search_range_forward_parallel(txt, start, end - start, regex, 1, match, 0, 0);
 
 	if (!found) {
 		start = 0;
 		end = pos;
-		found = !text_search_range_forward(txt, start, end, regex, 1, match, 0);
+		found = !text_search_range_forward_parallel(txt, start, end, regex, 1, match, 0, 0);
 	}
 
 	return found ? match[0].start : pos;
@@ -15,6 +15,9 @@ size_t text_end(Text*, size_t pos);
 /* char refers to a grapheme (might skip over multiple Unicode codepoints) */
 size_t text_char_next(Text*, size_t pos);
 size_t text_char_prev(Text*, size_t pos);
+/* same as above but moving count characters at once */
+size_t text_char_next_n(Text*, size_t pos, size_t count);
+size_t text_char_prev_n(Text*, size_t pos, size_t count);
 
 size_t text_codepoint_next(Text*, size_t pos);
 size_t text_codepoint_prev(Text*, size_t pos);
@@ -24,6 +27,9 @@ size_t text_codepoint_prev(Text*, size_t pos);
  * original position */
 size_t text_find_next(Text*, size_t pos, const char *s);
 size_t text_find_prev(Text*, size_t pos, const char *s);
+/* same as above but ASCII letters match regardless of their case */
+size_t text_find_next_icase(Text*, size_t pos, const char *s);
+size_t text_find_prev_icase(Text*, size_t pos, const char *s);
 /* same as above but limit searched range to the line containing pos */
 size_t text_line_find_next(Text*, size_t pos, const char *s);
 size_t text_line_find_prev(Text*, size_t pos, const char *s);
@@ -61,6 +67,13 @@ size_t text_line_blank_prev(Text*, size_t pos);
 /* move to same offset in previous/next line */
 size_t text_line_up(Text*, size_t pos);
 size_t text_line_down(Text*, size_t pos);
+/* same as above but moving count lines at once, stopping at the first/last line */
+size_t text_line_up_n(Text*, size_t pos, size_t count);
+size_t text_line_down_n(Text*, size_t pos, size_t count);
+/* begin of the line count lines before/after the one containing pos, located
+ * via the line number index instead of visiting each line in between */
+size_t text_line_prev_n(Text*, size_t pos, size_t count);
+size_t text_line_next_n(Text*, size_t pos, size_t count);
 /* functions to iterate over all line beginnings in a given range */
 size_t text_range_line_first(Text*, Filerange*);
 size_t text_range_line_last(Text*, Filerange*);
@@ -75,6 +88,11 @@ size_t text_longword_end_next(Text*, size_t pos);
 size_t text_longword_end_prev(Text*, size_t pos);
 size_t text_longword_start_next(Text*, size_t pos);
 size_t text_longword_start_prev(Text*, size_t pos);
+/* same as above but repeated count times, stopping once there are no more words */
+size_t text_longword_end_next_n(Text*, size_t pos, size_t count);
+size_t text_longword_end_prev_n(Text*, size_t pos, size_t count);
+size_t text_longword_start_next_n(Text*, size_t pos, size_t count);
+size_t text_longword_start_prev_n(Text*, size_t pos, size_t count);
 /*
  * A word consists of a sequence of letters, digits and underscores, or a
  * sequence of other non-blank characters, separated with white space.
@@ -85,6 +103,10 @@ size_t text_word_end_next(Text*, size_t pos);
 size_t text_word_end_prev(Text*, size_t pos);
 size_t text_word_start_next(Text*, size_t pos);
 size_t text_word_start_prev(Text*, size_t pos);
+size_t text_word_end_next_n(Text*, size_t pos, size_t count);
+size_t text_word_end_prev_n(Text*, size_t pos, size_t count);
+size_t text_word_start_next_n(Text*, size_t pos, size_t count);
+size_t text_word_start_prev_n(Text*, size_t pos, size_t count);
 /*
  * More general versions of the above, define your own word boundaries.
  */
@@ -108,6 +130,8 @@ size_t text_sentence_prev(Text*, size_t pos);
  */
 size_t text_paragraph_next(Text*, size_t pos);
 size_t text_paragraph_prev(Text*, size_t pos);
+size_t text_paragraph_next_n(Text*, size_t pos, size_t count);
+size_t text_paragraph_prev_n(Text*, size_t pos, size_t count);
 /* A section begins after a form-feed in the first column.
 size_t text_section_next(Text*, size_t pos);
 size_t text_section_prev(Text*, size_t pos);
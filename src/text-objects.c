@@ -310,14 +310,25 @@ Filerange text_object_search_backward(Text *txt, size_t pos, Regex *regex) {
 	return text_range_empty();
 }
 
-Filerange text_object_indentation(Text *txt, size_t pos) {
+/* get the length in bytes of the indentation of the line starting at bol
+ * and whether it is empty i.e. consists of nothing but a new line */
+static size_t text_line_indent(Text *txt, size_t bol, bool *empty) {
 	char c;
+	TextLineInfo info;
+	if (text_line_info(txt, bol, &info)) {
+		*empty = info.empty && bol < text_size(txt);
+		return info.indent_len;
+	}
+	*empty = text_byte_get(txt, bol, &c) && c == '\n';
+	return text_line_start(txt, bol) - bol;
+}
+
+Filerange text_object_indentation(Text *txt, size_t pos) {
+	bool line_empty;
 	size_t bol = text_line_begin(txt, pos);
-	size_t sol = text_line_start(txt, bol);
 	size_t start = bol;
 	size_t end = text_line_next(txt, bol);
-	size_t line_indent = sol - bol;
-	bool line_empty = text_byte_get(txt, bol, &c) && c == '\n';
+	size_t line_indent = text_line_indent(txt, bol, &line_empty);
 
 	char *buf = text_bytes_alloc0(txt, bol, line_indent);
 	char *tmp = malloc(line_indent);
@@ -329,11 +340,10 @@ Filerange text_object_indentation(Text *txt, size_t pos) {
 	}
 
 	while ((bol = text_line_begin(txt, text_line_prev(txt, start))) != start) {
-		sol = text_line_start(txt, bol);
-		size_t indent = sol - bol;
+		bool empty;
+		size_t indent = text_line_indent(txt, bol, &empty);
 		if (indent < line_indent)
 			break;
-		bool empty = text_byte_get(txt, bol, &c) && c == '\n';
 		if (line_empty && !empty)
 			break;
 		if (line_indent == 0 && empty)
@@ -346,11 +356,10 @@ Filerange text_object_indentation(Text *txt, size_t pos) {
 
 	do {
 		bol = end;
-		sol = text_line_start(txt, bol);
-		size_t indent = sol - bol;
+		bool empty;
+		size_t indent = text_line_indent(txt, bol, &empty);
 		if (indent < line_indent)
 			break;
-		bool empty = text_byte_get(txt, bol, &c) && c == '\n';
 		if (line_empty && !empty)
 			break;
 		if (line_indent == 0 && empty)
@@ -0,0 +1,90 @@
+#include <string.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "text-profile.h"
+#include "text-unicode.h"
+#include "util.h"
+
+/* bitmasks of the bytes of a block of up to 16 bytes which are of interest */
+typedef struct {
+	unsigned int nl, cr, nul, high;
+} Masks;
+
+static void masks_get(const unsigned char *s, size_t len, Masks *m) {
+#if defined(__SSE2__)
+	if (len == 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)s);
+		m->nl = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+		m->cr = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+		m->nul = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		m->high = _mm_movemask_epi8(v);
+		return;
+	}
+#endif
+	*m = (Masks){ 0 };
+	for (size_t i = 0; i < len; i++) {
+		m->nl |= (s[i] == '\n') << i;
+		m->cr |= (s[i] == '\r') << i;
+		m->nul |= (s[i] == '\0') << i;
+		m->high |= (s[i] >> 7) << i;
+	}
+}
+
+void text_profile_compute(TextProfile *p, const char *data, size_t len) {
+	const unsigned char *s = (const unsigned char*)data;
+	size_t bol = 0;    /* start of the current line */
+	size_t valid = 0;  /* UTF-8 sequences before this offset have been checked */
+	unsigned int cr = 0; /* whether the previous block ended with a carriage return */
+
+	uint8_t *ascii = p->ascii;
+	*p = (TextProfile){ .size = len, .ascii = ascii };
+	size_t regions = (len + TEXT_PROFILE_REGION - 1) / TEXT_PROFILE_REGION;
+	memset(ascii, 0xFF, (regions + 7) / 8);
+
+	for (size_t off = 0; off < len; off += 16) {
+		size_t n = MIN(len - off, 16);
+		Masks m;
+		masks_get(s + off, n, &m);
+		p->lines += __builtin_popcount(m.nl);
+		p->nul += __builtin_popcount(m.nul);
+		p->crlf += __builtin_popcount(m.nl & ((m.cr << 1) | cr));
+		cr = (m.cr >> (n - 1)) & 1;
+		for (unsigned int nl = m.nl; nl; nl &= nl - 1) {
+			size_t eol = off + __builtin_ctz(nl);
+			if (eol - bol > p->longest) {
+				p->longest = eol - bol;
+				p->longest_pos = bol;
+			}
+			bol = eol + 1;
+		}
+		if (!m.high)
+			continue;
+		/* blocks never straddle a region, its size being a multiple of 16 */
+		size_t region = off / TEXT_PROFILE_REGION;
+		ascii[region / 8] &= ~(1 << (region % 8));
+		p->non_ascii += __builtin_popcount(m.high);
+		/* sequences may extend into the following blocks */
+		size_t i = MAX(valid, off);
+		while (i < off + n) {
+			if (s[i] < 0x80) {
+				i++;
+				continue;
+			}
+			uint32_t cp;
+			size_t clen = text_utf8_decode(&cp, data + i, len - i);
+			if (clen == (size_t)-1 || clen == (size_t)-2) {
+				p->invalid++;
+				do i++; while (i < len && !ISUTF8(s[i]));
+			} else {
+				i += clen;
+			}
+		}
+		valid = i;
+	}
+
+	if (len - bol > p->longest) {
+		p->longest = len - bol;
+		p->longest_pos = bol;
+	}
+}
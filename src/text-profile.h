@@ -0,0 +1,13 @@
+#ifndef TEXT_PROFILE_H
+#define TEXT_PROFILE_H
+
+/* single pass content statistics, see text_profile */
+
+#include <stddef.h>
+#include "text.h"
+
+/* compute the statistics of len bytes of data. profile->ascii has to provide
+ * room for one bit per TEXT_PROFILE_REGION bytes, rounded up */
+void text_profile_compute(TextProfile *profile, const char *data, size_t len);
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "text-regex-cache.h"
+
+typedef struct RegexEntry RegexEntry;
+
+struct RegexEntry {
+	Regex *regex;
+	char *pattern;
+	int cflags;
+	size_t refs;              /* number of outstanding references */
+	RegexEntry *prev, *next;  /* most recently used entries come first */
+};
+
+struct RegexCache {
+	RegexEntry *head, *tail;
+	size_t max;
+	RegexCacheStats stats;
+};
+
+RegexCache *text_regex_cache_new(size_t max) {
+	RegexCache *cache = calloc(1, sizeof *cache);
+	if (!cache)
+		return NULL;
+	cache->max = max;
+	return cache;
+}
+
+static void entry_unlink(RegexCache *cache, RegexEntry *e) {
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		cache->head = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		cache->tail = e->prev;
+	e->prev = e->next = NULL;
+}
+
+static void entry_push(RegexCache *cache, RegexEntry *e) {
+	e->prev = NULL;
+	e->next = cache->head;
+	if (cache->head)
+		cache->head->prev = e;
+	else
+		cache->tail = e;
+	cache->head = e;
+}
+
+static void entry_free(RegexEntry *e) {
+	text_regex_free(e->regex);
+	free(e->pattern);
+	free(e);
+}
+
+/* drop the least recently used entries which are not referenced until the
+ * cache fits its size, referenced ones might keep it above */
+static void cache_shrink(RegexCache *cache) {
+	RegexEntry *e = cache->tail;
+	while (e && cache->stats.count > cache->max) {
+		RegexEntry *prev = e->prev;
+		if (!e->refs) {
+			entry_unlink(cache, e);
+			entry_free(e);
+			cache->stats.count--;
+			cache->stats.evictions++;
+		}
+		e = prev;
+	}
+}
+
+void text_regex_cache_free(RegexCache *cache) {
+	if (!cache)
+		return;
+	for (RegexEntry *e = cache->head, *next; e; e = next) {
+		next = e->next;
+		entry_free(e);
+	}
+	free(cache);
+}
+
+Regex *text_regex_cache_get(RegexCache *cache, const char *pattern, int cflags, int *error) {
+	if (error)
+		*error = 0;
+	for (RegexEntry *e = cache->head; e; e = e->next) {
+		if (e->cflags == cflags && !strcmp(e->pattern, pattern)) {
+			entry_unlink(cache, e);
+			entry_push(cache, e);
+			e->refs++;
+			cache->stats.hits++;
+			return e->regex;
+		}
+	}
+
+	cache->stats.misses++;
+	RegexEntry *e = calloc(1, sizeof *e);
+	if (!e)
+		goto err;
+	e->regex = text_regex_new();
+	e->pattern = strdup(pattern);
+	if (!e->regex || !e->pattern)
+		goto err;
+	int r = text_regex_compile(e->regex, pattern, cflags);
+	if (r) {
+		if (error)
+			*error = r;
+		goto invalid;
+	}
+	e->cflags = cflags;
+	e->refs = 1;
+	entry_push(cache, e);
+	cache->stats.count++;
+	cache_shrink(cache);
+	return e->regex;
+err:
+	if (error)
+		*error = REG_ESPACE;
+invalid:
+	if (e)
+		entry_free(e);
+	return NULL;
+}
+
+void text_regex_cache_release(RegexCache *cache, Regex *regex) {
+	for (RegexEntry *e = cache->head; e; e = e->next) {
+		if (e->regex == regex) {
+			if (e->refs > 0 && --e->refs == 0)
+				cache_shrink(cache);
+			return;
+		}
+	}
+}
+
+RegexCacheStats text_regex_cache_stats(RegexCache *cache) {
+	return cache->stats;
+}
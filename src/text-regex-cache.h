@@ -0,0 +1,31 @@
+#ifndef TEXT_REGEX_CACHE_H
+#define TEXT_REGEX_CACHE_H
+
+/* cache of compiled regular expressions keyed by pattern and compilation
+ * flags. expressions are reference counted, those which are not in use are
+ * evicted in least recently used order once the cache exceeds its size. */
+
+#include <stddef.h>
+#include "text-regex.h"
+
+typedef struct RegexCache RegexCache;
+
+typedef struct {
+	size_t hits;       /* lookups served by a cached expression */
+	size_t misses;     /* lookups which had to compile the pattern */
+	size_t evictions;  /* expressions dropped to respect the cache size */
+	size_t count;      /* expressions currently cached */
+} RegexCacheStats;
+
+/* create a cache holding up to max expressions which are not in use */
+RegexCache *text_regex_cache_new(size_t max);
+void text_regex_cache_free(RegexCache*);
+/* get the expression for the pattern compiled with cflags, taking a reference
+ * which has to be dropped with text_regex_cache_release. returns NULL if the
+ * pattern does not compile, the error code is then stored in error unless it
+ * is NULL */
+Regex *text_regex_cache_get(RegexCache*, const char *pattern, int cflags, int *error);
+void text_regex_cache_release(RegexCache*, Regex*);
+RegexCacheStats text_regex_cache_stats(RegexCache*);
+
+#endif
@@ -0,0 +1,1072 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* memmem(3) and memrchr(3) are non-standard */
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "text-regex.h"
+
+#if CONFIG_REGEX_DFA && !CONFIG_TRE
+
+#include "text-regex-dfa.h"
+#include "util.h"
+
+/* maximal number of NFA states, larger patterns are left to the C library */
+#ifndef REGEX_DFA_NFA_MAX
+#define REGEX_DFA_NFA_MAX 16384
+#endif
+
+/* maximal number of cached DFA states, the cache is flushed once it is full */
+#ifndef REGEX_DFA_STATES
+#define REGEX_DFA_STATES 2048
+#endif
+
+/* maximal length of the literal used to skip lines */
+#define LITERAL_MAX 64
+
+#define NONE ((size_t)-1)
+
+typedef struct {
+	uint64_t bits[4];
+} ByteSet;
+
+static void set_add(ByteSet *set, unsigned char c) {
+	set->bits[c / 64] |= (uint64_t)1 << (c % 64);
+}
+
+static void set_range(ByteSet *set, unsigned char lo, unsigned char hi) {
+	for (int c = lo; c <= hi; c++)
+		set_add(set, c);
+}
+
+static bool set_has(const ByteSet *set, unsigned char c) {
+	return set->bits[c / 64] & ((uint64_t)1 << (c % 64));
+}
+
+enum {
+	NFA_CHAR,   /* consume a byte of set, continue with out */
+	NFA_SPLIT,  /* continue with out and out1 */
+	NFA_BOL,    /* continue with out at the beginning of a line */
+	NFA_EOL,    /* continue with out at the end of a line */
+	NFA_MATCH,
+};
+
+typedef struct {
+	uint8_t type;
+	uint32_t out, out1;
+	uint32_t set;
+} NfaState;
+
+/* DFA state flags */
+#define ACCEPT       1  /* a match ends here */
+#define ACCEPT_EOL   2  /* a match ends here if it is the end of a line */
+#define DEAD         4  /* no match can be reached anymore */
+#define ACCEPT_EMPTY 8  /* same as ACCEPT_EOL, at the start of an empty line */
+
+typedef struct {
+	uint32_t *set;        /* sorted ids of the NFA states */
+	size_t len;
+	uint32_t hash;
+} DfaState;
+
+typedef struct {
+	uint32_t nfa;         /* NFA state matches start with */
+	bool unanchored;      /* whether a match may start at every position */
+	DfaState *states;
+	size_t count;
+	int32_t *trans;       /* count * classes transitions, -1 if not yet computed */
+	uint8_t *flags;
+	int32_t *table;       /* hash table of state indices */
+	int32_t start[2];     /* start states, indexed by whether at a line begin */
+} DfaCache;
+
+struct RegexDfa {
+	NfaState *nfa;
+	size_t nfa_len, nfa_size;
+	uint32_t start;
+	uint32_t reverse;     /* start of the reversed pattern, matching backwards */
+	ByteSet *sets;
+	size_t sets_len, sets_size;
+	uint8_t class[256];   /* bytes which are not distinguished share a class */
+	uint8_t repr[256];    /* a byte of each class */
+	size_t classes;
+	char literal[LITERAL_MAX]; /* contained in every match */
+	size_t literal_len;
+	bool skip;            /* whether the first byte of a match has to be in first */
+	bool first[256];
+	DfaCache anchored, unanchored, backward;
+	uint32_t *list, *stack, *mark, generation;
+};
+
+enum {
+	NODE_EMPTY,
+	NODE_SET,
+	NODE_CAT,
+	NODE_ALT,
+	NODE_REPEAT,
+	NODE_BOL,
+	NODE_EOL,
+};
+
+typedef struct {
+	int type;
+	uint32_t a, b;        /* operands */
+	int min, max;         /* repetition bounds, max is -1 if unbounded */
+	uint32_t set;
+} Node;
+
+typedef struct {
+	RegexDfa *dfa;
+	const unsigned char *s;
+	bool extended, icase, utf8;
+	bool error;           /* invalid or unsupported pattern */
+	bool reverse;         /* compile the NFA of the reversed pattern */
+	int depth;            /* nesting level of groups */
+	Node *nodes;          /* the first one is the empty node */
+	size_t nodes_len, nodes_size;
+} Parser;
+
+static uint32_t node_new(Parser *p, int type, uint32_t a, uint32_t b) {
+	if (p->error)
+		return 0;
+	if (p->nodes_len == p->nodes_size) {
+		size_t size = MAX(2 * p->nodes_size, 64);
+		Node *nodes = realloc(p->nodes, size * sizeof *nodes);
+		if (!nodes) {
+			p->error = true;
+			return 0;
+		}
+		p->nodes = nodes;
+		p->nodes_size = size;
+	}
+	p->nodes[p->nodes_len] = (Node){ .type = type, .a = a, .b = b };
+	return p->nodes_len++;
+}
+
+static uint32_t node_set(Parser *p, const ByteSet *set) {
+	RegexDfa *d = p->dfa;
+	if (d->sets_len == d->sets_size) {
+		size_t size = MAX(2 * d->sets_size, 16);
+		ByteSet *sets = realloc(d->sets, size * sizeof *sets);
+		if (!sets) {
+			p->error = true;
+			return 0;
+		}
+		d->sets = sets;
+		d->sets_size = size;
+	}
+	uint32_t n = node_new(p, NODE_SET, 0, 0);
+	if (n) {
+		p->nodes[n].set = d->sets_len;
+		d->sets[d->sets_len++] = *set;
+	}
+	return n;
+}
+
+static uint32_t node_range(Parser *p, unsigned char lo, unsigned char hi) {
+	ByteSet set = { 0 };
+	set_range(&set, lo, hi);
+	return node_set(p, &set);
+}
+
+static uint32_t node_byte(Parser *p, unsigned char c) {
+	ByteSet set = { 0 };
+	set_add(&set, c);
+	if (p->icase && isalpha(c) && c < 0x80)
+		set_add(&set, isupper(c) ? tolower(c) : toupper(c));
+	return node_set(p, &set);
+}
+
+static uint32_t node_cat(Parser *p, uint32_t a, uint32_t b) {
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+	return node_new(p, NODE_CAT, a, b);
+}
+
+/* any multibyte UTF-8 sequence, continuation bytes are not validated further */
+static uint32_t node_multibyte(Parser *p) {
+	uint32_t cont[3];
+	for (int i = 0; i < 3; i++)
+		cont[i] = node_range(p, 0x80, 0xBF);
+	uint32_t two = node_cat(p, node_range(p, 0xC2, 0xDF), cont[0]);
+	uint32_t three = node_cat(p, node_range(p, 0xE0, 0xEF), node_cat(p, cont[0], cont[1]));
+	uint32_t four = node_cat(p, node_range(p, 0xF0, 0xF4), node_cat(p, cont[0], node_cat(p, cont[1], cont[2])));
+	return node_new(p, NODE_ALT, two, node_new(p, NODE_ALT, three, four));
+}
+
+/* all characters of the given single byte set except the new line */
+static uint32_t node_complement(Parser *p, const ByteSet *set) {
+	ByteSet inv = { 0 };
+	for (int c = 0; c < (p->utf8 ? 0x80 : 0x100); c++) {
+		if (!set_has(set, c) && c != '\n')
+			set_add(&inv, c);
+	}
+	uint32_t n = node_set(p, &inv);
+	return p->utf8 ? node_new(p, NODE_ALT, n, node_multibyte(p)) : n;
+}
+
+static uint32_t node_any(Parser *p) {
+	ByteSet none = { 0 };
+	return node_complement(p, &none);
+}
+
+static uint32_t parse_alt(Parser *p);
+
+static uint32_t parse_error(Parser *p) {
+	p->error = true;
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	int (*is)(int);
+} char_classes[] = {
+	{ "alnum",  isalnum  },
+	{ "alpha",  isalpha  },
+	{ "blank",  isblank  },
+	{ "cntrl",  iscntrl  },
+	{ "digit",  isdigit  },
+	{ "graph",  isgraph  },
+	{ "lower",  islower  },
+	{ "print",  isprint  },
+	{ "punct",  ispunct  },
+	{ "space",  isspace  },
+	{ "upper",  isupper  },
+	{ "xdigit", isxdigit },
+};
+
+static uint32_t parse_bracket(Parser *p) {
+	const unsigned char *s = p->s + 1;
+	bool negate = *s == '^';
+	if (negate)
+		s++;
+	ByteSet set = { 0 };
+	for (bool first = true; first || *s != ']'; first = false) {
+		if (!*s)
+			return parse_error(p);
+		if (s[0] == '[' && s[1] == ':') {
+			/* only the ASCII members are known, non-ASCII ones depend on the locale */
+			if (p->utf8)
+				return parse_error(p);
+			const char *name = (const char*)s + 2;
+			const char *end = strstr(name, ":]");
+			if (!end)
+				return parse_error(p);
+			size_t i, len = end - name;
+			for (i = 0; i < LENGTH(char_classes); i++) {
+				if (strlen(char_classes[i].name) == len && !memcmp(char_classes[i].name, name, len))
+					break;
+			}
+			if (i == LENGTH(char_classes))
+				return parse_error(p);
+			for (int c = 0; c < 0x80; c++) {
+				if (char_classes[i].is(c))
+					set_add(&set, c);
+			}
+			s = (const unsigned char*)end + 2;
+			continue;
+		}
+		if (s[0] == '[' && (s[1] == '.' || s[1] == '='))
+			return parse_error(p); /* collating elements and equivalence classes */
+		unsigned char lo = *s++, hi = lo;
+		if (s[0] == '-' && s[1] && s[1] != ']') {
+			hi = s[1];
+			s += 2;
+			if (hi == '[' && (*s == '.' || *s == '=' || *s == ':'))
+				return parse_error(p);
+		}
+		if (hi < lo || (p->utf8 && hi >= 0x80))
+			return parse_error(p);
+		set_range(&set, lo, hi);
+	}
+	p->s = s + 1;
+	if (p->icase) {
+		for (int c = 'a'; c <= 'z'; c++) {
+			if (set_has(&set, c) || set_has(&set, toupper(c))) {
+				set_add(&set, c);
+				set_add(&set, toupper(c));
+			}
+		}
+	}
+	return negate ? node_complement(p, &set) : node_set(p, &set);
+}
+
+static bool parse_number(Parser *p, int *n) {
+	if (!isdigit(*p->s))
+		return false;
+	for (*n = 0; isdigit(*p->s); p->s++) {
+		*n = 10 * *n + *p->s - '0';
+		if (*n > RE_DUP_MAX)
+			return false;
+	}
+	return true;
+}
+
+/* bounds of an interval expression, the opening brace has been consumed */
+static bool parse_interval(Parser *p, int *min, int *max) {
+	if (!parse_number(p, min))
+		return false;
+	*max = *min;
+	if (*p->s == ',') {
+		p->s++;
+		if (!parse_number(p, max))
+			*max = -1;
+	}
+	if (!p->extended && *p->s++ != '\\')
+		return false;
+	if (*p->s++ != '}')
+		return false;
+	return *max == -1 || *min <= *max;
+}
+
+/* whether a basic regular expression ends at s, i.e. $ is an anchor */
+static bool basic_end(const unsigned char *s) {
+	return !s[0] || (s[0] == '\\' && (s[1] == ')' || s[1] == '|'));
+}
+
+static uint32_t parse_atom(Parser *p, bool first) {
+	const unsigned char *s = p->s;
+	unsigned char c = *s;
+	if (p->extended) {
+		switch (c) {
+		case '(':
+			p->s++;
+			p->depth++;
+			uint32_t n = parse_alt(p);
+			if (*p->s != ')')
+				return parse_error(p);
+			p->s++;
+			p->depth--;
+			return n;
+		case ')': case '*': case '+': case '?': case '{':
+			return parse_error(p);
+		case '^':
+			p->s++;
+			return node_new(p, NODE_BOL, 0, 0);
+		case '$':
+			p->s++;
+			return node_new(p, NODE_EOL, 0, 0);
+		}
+	} else {
+		if (c == '^' && first) {
+			p->s++;
+			return node_new(p, NODE_BOL, 0, 0);
+		}
+		if (c == '$' && basic_end(s + 1)) {
+			p->s++;
+			return node_new(p, NODE_EOL, 0, 0);
+		}
+		if (c == '*' && first) {
+			p->s++;
+			return node_byte(p, c);
+		}
+		if (c == '\\' && s[1] == '(') {
+			p->s += 2;
+			p->depth++;
+			uint32_t n = parse_alt(p);
+			if (p->s[0] != '\\' || p->s[1] != ')')
+				return parse_error(p);
+			p->s += 2;
+			p->depth--;
+			return n;
+		}
+		if (c == '\\' && (s[1] == '{' || s[1] == ')'))
+			return parse_error(p);
+	}
+	switch (c) {
+	case '.':
+		p->s++;
+		return node_any(p);
+	case '[':
+		return parse_bracket(p);
+	case '\\':
+		c = s[1];
+		/* back references and GNU extensions */
+		if (!c || (isdigit(c) && c != '0') || strchr("bB<>`'wWsS", c))
+			return parse_error(p);
+		p->s += 2;
+		return node_byte(p, c);
+	}
+	p->s++;
+	uint32_t n = node_byte(p, c);
+	/* a multibyte character is repeated as a whole */
+	while (p->utf8 && c >= 0xC0 && (*p->s & 0xC0) == 0x80)
+		n = node_cat(p, n, node_byte(p, *p->s++));
+	return n;
+}
+
+static uint32_t parse_repeat(Parser *p, bool first) {
+	uint32_t n = parse_atom(p, first);
+	while (!p->error) {
+		const unsigned char *s = p->s;
+		int min, max;
+		if (s[0] == '*') {
+			p->s++;
+			min = 0;
+			max = -1;
+		} else if (p->extended && (s[0] == '+' || s[0] == '?')) {
+			p->s++;
+			min = s[0] == '+';
+			max = s[0] == '+' ? -1 : 1;
+		} else if (!p->extended && s[0] == '\\' && (s[1] == '+' || s[1] == '?')) {
+			p->s += 2;
+			min = s[1] == '+';
+			max = s[1] == '+' ? -1 : 1;
+		} else if (p->extended && s[0] == '{') {
+			p->s++;
+			if (!parse_interval(p, &min, &max))
+				return parse_error(p);
+		} else if (!p->extended && s[0] == '\\' && s[1] == '{') {
+			p->s += 2;
+			if (!parse_interval(p, &min, &max))
+				return parse_error(p);
+		} else {
+			break;
+		}
+		int type = p->nodes[n].type;
+		if (type == NODE_BOL || type == NODE_EOL) {
+			if (p->extended)
+				return parse_error(p);
+			/* a star following a leading ^ is an ordinary character */
+			p->s = s;
+			break;
+		}
+		if (max == 0) {
+			n = 0;
+		} else if (n) {
+			n = node_new(p, NODE_REPEAT, n, 0);
+			p->nodes[n].min = min;
+			p->nodes[n].max = max;
+		}
+	}
+	return n;
+}
+
+static bool parse_alt_next(Parser *p) {
+	const unsigned char *s = p->s;
+	if (p->extended)
+		return s[0] == '|';
+	return s[0] == '\\' && s[1] == '|';
+}
+
+static uint32_t parse_cat(Parser *p) {
+	uint32_t n = 0;
+	for (bool first = true; !p->error && *p->s && !parse_alt_next(p); ) {
+		const unsigned char *s = p->s;
+		if (p->depth > 0 && (p->extended ? s[0] == ')' : s[0] == '\\' && s[1] == ')'))
+			break;
+		uint32_t a = parse_repeat(p, first);
+		first = !p->extended && a && p->nodes[a].type == NODE_BOL;
+		n = node_cat(p, n, a);
+	}
+	return n;
+}
+
+static uint32_t parse_alt(Parser *p) {
+	uint32_t n = parse_cat(p);
+	while (!p->error && parse_alt_next(p)) {
+		p->s += p->extended ? 1 : 2;
+		n = node_new(p, NODE_ALT, n, parse_cat(p));
+	}
+	return n;
+}
+
+/* literal information of a subexpression: the string it matches exactly
+ * if it is fixed, strings every match starts and ends with and the longest
+ * string every match contains */
+typedef struct {
+	char exact[LITERAL_MAX], prefix[LITERAL_MAX], suffix[LITERAL_MAX], must[LITERAL_MAX];
+	int exact_len; /* -1 if not fixed */
+	size_t prefix_len, suffix_len, must_len;
+} Literal;
+
+static void literal_set(char *dst, size_t *dst_len, const char *s1, size_t len1, const char *s2, size_t len2, bool tail) {
+	char buf[2*LITERAL_MAX];
+	memcpy(buf, s1, len1);
+	memcpy(buf + len1, s2, len2);
+	size_t len = len1 + len2, off = 0;
+	if (len > LITERAL_MAX) {
+		off = tail ? len - LITERAL_MAX : 0;
+		len = LITERAL_MAX;
+	}
+	memcpy(dst, buf + off, len);
+	*dst_len = len;
+}
+
+static void literal_must(Literal *l, const char *s, size_t len) {
+	if (len > l->must_len)
+		literal_set(l->must, &l->must_len, s, len, "", 0, false);
+}
+
+static void literal_get(Parser *p, uint32_t node, Literal *l) {
+	const Node *n = &p->nodes[node];
+	Literal a, b;
+	*l = (Literal){ .exact_len = -1 };
+	switch (n->type) {
+	case NODE_EMPTY:
+	case NODE_BOL:
+	case NODE_EOL:
+		l->exact_len = 0;
+		break;
+	case NODE_SET: {
+		const ByteSet *set = &p->dfa->sets[n->set];
+		int c, count = 0;
+		for (int i = 0; i < 256; i++) {
+			if (set_has(set, i)) {
+				c = i;
+				count++;
+			}
+		}
+		if (count == 1) {
+			l->exact[0] = l->prefix[0] = l->suffix[0] = l->must[0] = c;
+			l->exact_len = l->prefix_len = l->suffix_len = l->must_len = 1;
+		}
+		break;
+	}
+	case NODE_CAT: {
+		literal_get(p, n->a, &a);
+		literal_get(p, n->b, &b);
+		size_t len;
+		if (a.exact_len >= 0 && b.exact_len >= 0 && a.exact_len + b.exact_len <= LITERAL_MAX) {
+			literal_set(l->exact, &len, a.exact, a.exact_len, b.exact, b.exact_len, false);
+			l->exact_len = len;
+		}
+		if (a.exact_len >= 0)
+			literal_set(l->prefix, &l->prefix_len, a.exact, a.exact_len, b.prefix, b.prefix_len, false);
+		else
+			literal_set(l->prefix, &l->prefix_len, a.prefix, a.prefix_len, "", 0, false);
+		if (b.exact_len >= 0)
+			literal_set(l->suffix, &l->suffix_len, a.suffix, a.suffix_len, b.exact, b.exact_len, true);
+		else
+			literal_set(l->suffix, &l->suffix_len, b.suffix, b.suffix_len, "", 0, true);
+		literal_must(l, a.must, a.must_len);
+		literal_must(l, b.must, b.must_len);
+		char junction[LITERAL_MAX];
+		literal_set(junction, &len, a.suffix, a.suffix_len, b.prefix, b.prefix_len, false);
+		literal_must(l, junction, len);
+		literal_must(l, l->prefix, l->prefix_len);
+		literal_must(l, l->suffix, l->suffix_len);
+		break;
+	}
+	case NODE_REPEAT:
+		if (n->min > 0) {
+			literal_get(p, n->a, &a);
+			literal_set(l->prefix, &l->prefix_len, a.prefix, a.prefix_len, "", 0, false);
+			literal_set(l->suffix, &l->suffix_len, a.suffix, a.suffix_len, "", 0, true);
+			literal_must(l, a.must, a.must_len);
+		}
+		break;
+	}
+}
+
+static uint32_t nfa_new(Parser *p, int type, uint32_t out, uint32_t out1) {
+	RegexDfa *d = p->dfa;
+	if (p->error)
+		return 0;
+	if (d->nfa_len == d->nfa_size) {
+		size_t size = MAX(2 * d->nfa_size, 64);
+		NfaState *nfa = size <= REGEX_DFA_NFA_MAX ? realloc(d->nfa, size * sizeof *nfa) : NULL;
+		if (!nfa) {
+			p->error = true;
+			return 0;
+		}
+		d->nfa = nfa;
+		d->nfa_size = size;
+	}
+	d->nfa[d->nfa_len] = (NfaState){ .type = type, .out = out, .out1 = out1 };
+	return d->nfa_len++;
+}
+
+/* NFA states matching the subexpression and continuing with next */
+static uint32_t nfa_compile(Parser *p, uint32_t node, uint32_t next) {
+	const Node *n = &p->nodes[node];
+	RegexDfa *d = p->dfa;
+	uint32_t s, a, b;
+	switch (n->type) {
+	case NODE_EMPTY:
+		return next;
+	case NODE_SET:
+		s = nfa_new(p, NFA_CHAR, next, 0);
+		if (!p->error)
+			d->nfa[s].set = n->set;
+		return s;
+	case NODE_BOL:
+		return nfa_new(p, p->reverse ? NFA_EOL : NFA_BOL, next, 0);
+	case NODE_EOL:
+		return nfa_new(p, p->reverse ? NFA_BOL : NFA_EOL, next, 0);
+	case NODE_CAT:
+		if (p->reverse)
+			return nfa_compile(p, n->b, nfa_compile(p, n->a, next));
+		return nfa_compile(p, n->a, nfa_compile(p, n->b, next));
+	case NODE_ALT:
+		a = nfa_compile(p, n->a, next);
+		b = nfa_compile(p, n->b, next);
+		return nfa_new(p, NFA_SPLIT, a, b);
+	case NODE_REPEAT:
+		if (n->max < 0) {
+			s = nfa_new(p, NFA_SPLIT, 0, next);
+			a = nfa_compile(p, n->a, s);
+			if (!p->error)
+				d->nfa[s].out = a;
+			next = s;
+		} else {
+			/* nested optional copies a(a(a)?)? */
+			uint32_t opt = next;
+			for (int i = n->min; i < n->max; i++) {
+				a = nfa_compile(p, n->a, opt);
+				opt = nfa_new(p, NFA_SPLIT, a, next);
+			}
+			next = opt;
+		}
+		for (int i = 0; i < n->min; i++)
+			next = nfa_compile(p, n->a, next);
+		return next;
+	}
+	return next;
+}
+
+/* partition the bytes into classes which no byte set distinguishes */
+static void classes_init(RegexDfa *d) {
+	memset(d->class, 0, sizeof d->class);
+	size_t classes = 1;
+	for (size_t i = 0; i < d->sets_len; i++) {
+		int16_t map[2*256];
+		memset(map, -1, sizeof map);
+		size_t count = 0;
+		for (int c = 0; c < 256; c++) {
+			int key = 2 * d->class[c] + set_has(&d->sets[i], c);
+			if (map[key] < 0)
+				map[key] = count++;
+			d->class[c] = map[key];
+		}
+		classes = count;
+	}
+	d->classes = classes;
+	for (int c = 255; c >= 0; c--)
+		d->repr[d->class[c]] = c;
+}
+
+static void cache_reset(DfaCache *c) {
+	for (size_t i = 0; i < c->count; i++)
+		free(c->states[i].set);
+	c->count = 0;
+	c->start[0] = c->start[1] = -1;
+	memset(c->table, 0xFF, 2 * REGEX_DFA_STATES * sizeof *c->table);
+}
+
+static bool cache_init(DfaCache *c, size_t classes, uint32_t nfa, bool unanchored) {
+	c->nfa = nfa;
+	c->unanchored = unanchored;
+	c->states = calloc(REGEX_DFA_STATES, sizeof *c->states);
+	c->trans = malloc(REGEX_DFA_STATES * classes * sizeof *c->trans);
+	c->flags = malloc(REGEX_DFA_STATES);
+	c->table = malloc(2 * REGEX_DFA_STATES * sizeof *c->table);
+	if (!c->states || !c->trans || !c->flags || !c->table)
+		return false;
+	cache_reset(c);
+	return true;
+}
+
+static void cache_free(DfaCache *c) {
+	if (c->states)
+		cache_reset(c);
+	free(c->states);
+	free(c->trans);
+	free(c->flags);
+	free(c->table);
+}
+
+/* add the states reachable from id without consuming input to the list */
+static size_t closure(RegexDfa *d, uint32_t id, bool bol, size_t len) {
+	size_t sp = 0;
+	d->stack[sp++] = id;
+	while (sp > 0) {
+		id = d->stack[--sp];
+		if (d->mark[id] == d->generation)
+			continue;
+		d->mark[id] = d->generation;
+		const NfaState *n = &d->nfa[id];
+		switch (n->type) {
+		case NFA_SPLIT:
+			d->stack[sp++] = n->out1;
+			d->stack[sp++] = n->out;
+			break;
+		case NFA_BOL:
+			if (bol)
+				d->stack[sp++] = n->out;
+			break;
+		default:
+			d->list[len++] = id;
+			break;
+		}
+	}
+	return len;
+}
+
+/* whether the state set matches once the end of a line is asserted, and if
+ * bol is set the start of a line as well, i.e. at an empty line */
+static bool accept_eol(RegexDfa *d, const uint32_t *set, size_t len, bool bol) {
+	size_t sp = 0;
+	d->generation++;
+	for (size_t i = 0; i < len; i++) {
+		if (d->nfa[set[i]].type == NFA_EOL)
+			d->stack[sp++] = d->nfa[set[i]].out;
+	}
+	while (sp > 0) {
+		uint32_t id = d->stack[--sp];
+		if (d->mark[id] == d->generation)
+			continue;
+		d->mark[id] = d->generation;
+		const NfaState *n = &d->nfa[id];
+		switch (n->type) {
+		case NFA_MATCH:
+			return true;
+		case NFA_SPLIT:
+			d->stack[sp++] = n->out1;
+			/* fall through */
+		case NFA_EOL:
+			d->stack[sp++] = n->out;
+			break;
+		case NFA_BOL:
+			if (bol)
+				d->stack[sp++] = n->out;
+			break;
+		}
+	}
+	return false;
+}
+
+static int id_cmp(const void *a, const void *b) {
+	uint32_t i = *(const uint32_t*)a, j = *(const uint32_t*)b;
+	return (i > j) - (i < j);
+}
+
+/* DFA state of the NFA state set in d->list, -1 if the cache is full */
+static int32_t cache_state(RegexDfa *d, DfaCache *c, size_t len) {
+	const uint32_t *set = d->list;
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ set[i]) * 16777619u;
+	size_t mask = 2 * REGEX_DFA_STATES - 1, i;
+	for (i = hash & mask; c->table[i] >= 0; i = (i + 1) & mask) {
+		const DfaState *s = &c->states[c->table[i]];
+		if (s->hash == hash && s->len == len && !memcmp(s->set, set, len * sizeof *set))
+			return c->table[i];
+	}
+	if (c->count == REGEX_DFA_STATES)
+		return -1;
+	uint32_t *copy = malloc(MAX(len, 1) * sizeof *copy);
+	if (!copy)
+		return -2;
+	memcpy(copy, set, len * sizeof *set);
+	int32_t id = c->count++;
+	c->states[id] = (DfaState){ .set = copy, .len = len, .hash = hash };
+	c->table[i] = id;
+	memset(&c->trans[id * d->classes], 0xFF, d->classes * sizeof *c->trans);
+	uint8_t flags = len == 0 ? DEAD : 0;
+	for (size_t j = 0; j < len; j++) {
+		if (d->nfa[set[j]].type == NFA_MATCH)
+			flags |= ACCEPT | ACCEPT_EOL;
+	}
+	if (flags & ACCEPT)
+		flags |= ACCEPT_EMPTY;
+	else if (accept_eol(d, set, len, false))
+		flags |= ACCEPT_EOL | ACCEPT_EMPTY;
+	else if (accept_eol(d, set, len, true))
+		flags |= ACCEPT_EMPTY;
+	c->flags[id] = flags;
+	return id;
+}
+
+/* look up the state set in d->list, flushing the cache if it is full */
+static int32_t cache_add(RegexDfa *d, DfaCache *c, size_t len, bool *flushed) {
+	qsort(d->list, len, sizeof *d->list, id_cmp);
+	int32_t id = cache_state(d, c, len);
+	*flushed = id == -1;
+	if (id == -1) {
+		cache_reset(c);
+		id = cache_state(d, c, len);
+	}
+	return id;
+}
+
+static int32_t dfa_start(RegexDfa *d, DfaCache *c, bool bol) {
+	if (c->start[bol] >= 0)
+		return c->start[bol];
+	bool flushed;
+	d->generation++;
+	size_t len = closure(d, c->nfa, bol, 0);
+	int32_t id = cache_add(d, c, len, &flushed);
+	if (id >= 0)
+		c->start[bol] = id;
+	return id;
+}
+
+/* DFA state of c with the same NFA states as the given one of another cache */
+static int32_t dfa_copy(RegexDfa *d, DfaCache *c, const DfaState *s) {
+	bool flushed;
+	memcpy(d->list, s->set, s->len * sizeof *s->set);
+	return cache_add(d, c, s->len, &flushed);
+}
+
+static int32_t dfa_step(RegexDfa *d, DfaCache *c, int32_t id, uint8_t cls) {
+	const DfaState *s = &c->states[id];
+	unsigned char b = d->repr[cls];
+	size_t len = 0;
+	d->generation++;
+	for (size_t i = 0; i < s->len; i++) {
+		const NfaState *n = &d->nfa[s->set[i]];
+		if (n->type == NFA_CHAR && set_has(&d->sets[n->set], b))
+			len = closure(d, n->out, false, len);
+	}
+	if (c->unanchored)
+		len = closure(d, c->nfa, false, len);
+	bool flushed;
+	int32_t next = cache_add(d, c, len, &flushed);
+	if (next >= 0 && !flushed)
+		c->trans[id * d->classes + cls] = next;
+	return next;
+}
+
+#define STEP(d, c, id, byte) do { \
+	uint8_t cls = (d)->class[byte]; \
+	int32_t next = (c)->trans[(id) * (d)->classes + cls]; \
+	if (next < 0 && (next = dfa_step((d), (c), (id), cls)) < 0) \
+		return NONE; \
+	(id) = next; \
+} while (0)
+
+/* the bytes a match can start with, unless it may be empty or start
+ * with an anchor */
+static void first_init(RegexDfa *d) {
+	d->generation++;
+	size_t len = closure(d, d->start, true, 0);
+	d->skip = true;
+	for (size_t i = 0; i < len; i++) {
+		const NfaState *n = &d->nfa[d->list[i]];
+		if (n->type != NFA_CHAR) {
+			d->skip = false;
+			return;
+		}
+		for (int c = 0; c < 256; c++)
+			d->first[c] |= set_has(&d->sets[n->set], c);
+	}
+}
+
+/* end of the first match within the line s[from..le), the DFA state
+ * reached there is stored in state */
+static size_t dfa_first_end(RegexDfa *d, const unsigned char *s, size_t from, size_t le, bool bol, bool eol, int32_t *state) {
+	DfaCache *c = &d->unanchored;
+	if (d->skip && dfa_start(d, c, false) < 0)
+		return NONE;
+	int32_t id = *state = dfa_start(d, c, bol);
+	if (id < 0)
+		return NONE;
+	if (c->flags[id] & ACCEPT)
+		return from;
+	for (size_t i = from; i < le; i++) {
+		if (d->skip && id == c->start[0]) {
+			/* nothing matched so far, advance to a possible start */
+			while (i + 4 <= le && !(d->first[s[i]] | d->first[s[i+1]] | d->first[s[i+2]] | d->first[s[i+3]]))
+				i += 4;
+			while (i < le && !d->first[s[i]])
+				i++;
+			if (i == le)
+				break;
+		}
+		STEP(d, c, id, s[i]);
+		if (c->flags[id] & ACCEPT) {
+			*state = id;
+			return i + 1;
+		}
+	}
+	*state = id;
+	uint8_t accept = bol && from == le ? ACCEPT_EMPTY : ACCEPT_EOL;
+	return eol && (c->flags[id] & accept) ? le : NONE;
+}
+
+/* end of the last match starting at or before first, the end of the first
+ * match whose unanchored DFA state is given */
+static size_t dfa_last_end(RegexDfa *d, const unsigned char *s, size_t first, size_t le, bool eol, int32_t state) {
+	DfaCache *c = &d->anchored;
+	int32_t id = dfa_copy(d, c, &d->unanchored.states[state]);
+	if (id < 0)
+		return NONE;
+	size_t end = first;
+	for (size_t i = first; i < le; i++) {
+		STEP(d, c, id, s[i]);
+		if (c->flags[id] & DEAD)
+			return end;
+		if (c->flags[id] & ACCEPT)
+			end = i + 1;
+	}
+	return eol && (c->flags[id] & ACCEPT_EOL) ? le : end;
+}
+
+/* start of the leftmost match within s[from..end), the reversed pattern is
+ * matched backwards from every position */
+static size_t dfa_leftmost(RegexDfa *d, const unsigned char *s, size_t from, size_t end, size_t le, bool bol, bool eol) {
+	DfaCache *c = &d->backward;
+	int32_t id = dfa_start(d, c, eol && end == le);
+	if (id < 0)
+		return NONE;
+	size_t start = c->flags[id] & ACCEPT ? end : NONE;
+	for (size_t i = end; i > from; i--) {
+		STEP(d, c, id, s[i-1]);
+		if (c->flags[id] & ACCEPT)
+			start = i - 1;
+	}
+	uint8_t accept = eol && from == le ? ACCEPT_EMPTY : ACCEPT_EOL;
+	return bol && (c->flags[id] & accept) ? from : start;
+}
+
+/* end of the longest match starting at start within the line s[..le) */
+static size_t dfa_longest(RegexDfa *d, const unsigned char *s, size_t start, size_t le, bool bol, bool eol) {
+	DfaCache *c = &d->anchored;
+	int32_t id = dfa_start(d, c, bol);
+	if (id < 0)
+		return NONE;
+	size_t end = c->flags[id] & ACCEPT ? start : NONE;
+	for (size_t i = start; i < le; i++) {
+		STEP(d, c, id, s[i]);
+		if (c->flags[id] & DEAD)
+			return end;
+		if (c->flags[id] & ACCEPT)
+			end = i + 1;
+	}
+	uint8_t accept = bol && start == le ? ACCEPT_EMPTY : ACCEPT_EOL;
+	return eol && (c->flags[id] & accept) ? le : end;
+}
+
+/* the leftmost match starts at the latest where the first one ends. unless
+ * it starts at the first candidate, it is found by matching the reversed
+ * pattern backwards from the end of the last match starting up to there,
+ * such that every byte is visited a bounded number of times */
+static bool dfa_line(RegexDfa *d, const unsigned char *s, size_t from, size_t le, bool bol, bool eol, size_t *start, size_t *end) {
+	int32_t state;
+	size_t first = dfa_first_end(d, s, from, le, bol, eol, &state);
+	if (first == NONE)
+		return false;
+	size_t i = from;
+	while (d->skip && i < first && !d->first[s[i]])
+		i++;
+	size_t e = dfa_longest(d, s, i, le, bol && i == from, eol);
+	if (e == NONE && i < first) {
+		size_t last = dfa_last_end(d, s, first, le, eol, state);
+		if (last == NONE)
+			return false;
+		i = dfa_leftmost(d, s, from, last, le, bol, eol);
+		if (i == NONE)
+			return false;
+		e = dfa_longest(d, s, i, le, bol && i == from, eol);
+	}
+	if (e == NONE)
+		return false;
+	*start = i;
+	*end = e;
+	return true;
+}
+
+bool text_regex_dfa_search(RegexDfa *d, const char *data, size_t len, size_t from, int eflags, size_t *start, size_t *end) {
+	const unsigned char *s = (const unsigned char*)data;
+	while (from <= len) {
+		if (d->literal_len) {
+			/* skip lines without the required literal */
+			const char *match = memmem(data + from, len - from, d->literal, d->literal_len);
+			if (!match)
+				return false;
+			const char *nl = memrchr(data + from, '\n', match - (data + from));
+			if (nl)
+				from = nl + 1 - data;
+		}
+		const char *nl = memchr(data + from, '\n', len - from);
+		size_t le = nl ? (size_t)(nl - data) : len;
+		bool bol = from == 0 ? !(eflags & REG_NOTBOL) : data[from-1] == '\n';
+		bool eol = le < len || !(eflags & REG_NOTEOL);
+		if (dfa_line(d, s, from, le, bol, eol, start, end))
+			return true;
+		if (le == len)
+			break;
+		from = le + 1;
+	}
+	return false;
+}
+
+RegexDfa *text_regex_dfa_new(const char *pattern, int cflags) {
+	if (!(cflags & REG_NEWLINE) || strchr(pattern, '\n'))
+		return NULL;
+	/* in a multibyte locale even ASCII letters have non-ASCII case variants,
+	 * e.g. s matches U+017F */
+	if ((cflags & REG_ICASE) && MB_CUR_MAX > 1)
+		return NULL;
+	RegexDfa *d = calloc(1, sizeof *d);
+	if (!d)
+		return NULL;
+	Parser p = {
+		.dfa = d,
+		.s = (const unsigned char*)pattern,
+		.extended = cflags & REG_EXTENDED,
+		.icase = cflags & REG_ICASE,
+		.utf8 = MB_CUR_MAX > 1,
+	};
+	node_new(&p, NODE_EMPTY, 0, 0);
+	uint32_t root = parse_alt(&p);
+	if (*p.s)
+		p.error = true; /* unbalanced parenthesis */
+
+	if (!p.error) {
+		Literal l;
+		literal_get(&p, root, &l);
+		bool letters = false;
+		for (size_t i = 0; i < l.must_len; i++)
+			letters |= isalpha((unsigned char)l.must[i]);
+		if (!(p.icase && letters)) {
+			memcpy(d->literal, l.must, l.must_len);
+			d->literal_len = l.must_len;
+		}
+	}
+
+	uint32_t match = nfa_new(&p, NFA_MATCH, 0, 0);
+	d->start = nfa_compile(&p, root, match);
+	p.reverse = true;
+	d->reverse = nfa_compile(&p, root, match);
+	free(p.nodes);
+	if (p.error)
+		goto err;
+
+	classes_init(d);
+	d->list = malloc(d->nfa_len * sizeof *d->list);
+	d->mark = calloc(d->nfa_len, sizeof *d->mark);
+	d->stack = malloc(2 * d->nfa_len * sizeof *d->stack);
+	if (!d->list || !d->mark || !d->stack)
+		goto err;
+	first_init(d);
+	if (!cache_init(&d->anchored, d->classes, d->start, false) ||
+	    !cache_init(&d->unanchored, d->classes, d->start, true) ||
+	    !cache_init(&d->backward, d->classes, d->reverse, true))
+		goto err;
+	return d;
+err:
+	text_regex_dfa_free(d);
+	return NULL;
+}
+
+void text_regex_dfa_free(RegexDfa *d) {
+	if (!d)
+		return;
+	cache_free(&d->anchored);
+	cache_free(&d->unanchored);
+	cache_free(&d->backward);
+	free(d->nfa);
+	free(d->sets);
+	free(d->list);
+	free(d->mark);
+	free(d->stack);
+	free(d);
+}
+
+#endif
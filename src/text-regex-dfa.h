@@ -0,0 +1,28 @@
+#ifndef TEXT_REGEX_DFA_H
+#define TEXT_REGEX_DFA_H
+
+/* regex engine for patterns whose matches never span lines. the pattern is
+ * compiled into a Thompson NFA which is lazily turned into a DFA whose states
+ * are cached up to a fixed limit. lines which can not contain a match because
+ * they lack a literal required by the pattern are skipped using memmem(3).
+ *
+ * matches are POSIX leftmost-longest, only the extent of the whole match is
+ * reported. new lines delimit lines, NUL bytes are ordinary characters. */
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct RegexDfa RegexDfa;
+
+/* compile a POSIX basic or extended (REG_EXTENDED) regular expression, the
+ * cflags have to include REG_NEWLINE. returns NULL if the pattern is invalid
+ * or uses unsupported features such as back references, collating elements
+ * or equivalence classes. in multibyte locales character classes and
+ * REG_ICASE are not supported either, they are not limited to ASCII */
+RegexDfa *text_regex_dfa_new(const char *pattern, int cflags);
+void text_regex_dfa_free(RegexDfa*);
+/* search the leftmost-longest match starting at or after from in data[0..len).
+ * the eflags REG_NOTBOL and REG_NOTEOL apply to the start and end of data */
+bool text_regex_dfa_search(RegexDfa*, const char *data, size_t len, size_t from, int eflags, size_t *start, size_t *end);
+
+#endif
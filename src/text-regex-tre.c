@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "text-regex.h"
+#include "text-motions.h"
+#include "text-unicode.h"
+#include "util.h"
+
+#if CONFIG_TRE
+
+/* the text is fed to the matcher through a callback interface which walks
+ * the piece chain directly, memory usage is independent of the searched
+ * range. positions reported by TRE are relative to the search start. */
+
+struct Regex {
+	regex_t regex;
+	tre_str_source source;
+	Text *text;
+	Iterator it;   /* position of the next character */
+	size_t start;  /* start of the searched range */
+	size_t end;    /* end of the searched range */
+	char *pattern; /* source of the compiled expression */
+	int cflags;
+	bool lines;    /* matches never contain a new line */
+};
+
+static int str_next_char(tre_char_t *c, unsigned int *pos_add, void *context) {
+	Regex *r = context;
+	Iterator *it = &r->it;
+	*pos_add = 1;
+	if (it->pos >= r->end || !text_iterator_valid(it)) {
+		*c = '\0';
+		return 1;
+	}
+	size_t len = 1;
+#if TRE_WCHAR
+	/* decode UTF-8, invalid sequences are passed on byte wise */
+	char buf[UTF8_LEN_MAX];
+	const char *s = it->text;
+	size_t avail = MIN(r->end - it->pos, UTF8_LEN_MAX);
+	if ((size_t)(it->end - it->text) < avail) {
+		Iterator tmp = *it;
+		size_t n;
+		for (n = 0; n < avail && text_iterator_byte_get(&tmp, &buf[n]); n++)
+			text_iterator_byte_next(&tmp, NULL);
+		s = buf;
+		avail = n;
+	}
+	uint32_t cp;
+	len = avail ? text_utf8_decode(&cp, s, avail) : (size_t)-1;
+	if (len == (size_t)-1 || len == (size_t)-2 || len == 0) {
+		cp = (unsigned char)*s;
+		len = 1;
+	}
+	*c = cp;
+#else
+	*c = (unsigned char)*it->text;
+#endif
+	*pos_add = len;
+	while (len-- > 0)
+		text_iterator_byte_next(it, NULL);
+	return 0;
+}
+
+static void str_rewind(size_t pos, void *context) {
+	Regex *r = context;
+	r->it = text_iterator_get(r->text, r->start + pos);
+}
+
+static int str_compare(size_t pos1, size_t pos2, size_t len, void *context) {
+	Regex *r = context;
+	Iterator it1 = text_iterator_get(r->text, r->start + pos1);
+	Iterator it2 = text_iterator_get(r->text, r->start + pos2);
+	for (char c1, c2; len > 0; len--) {
+		if (!text_iterator_byte_get(&it1, &c1) || !text_iterator_byte_get(&it2, &c2) || c1 != c2)
+			return 1;
+		text_iterator_byte_next(&it1, NULL);
+		text_iterator_byte_next(&it2, NULL);
+	}
+	return 0;
+}
+
+Regex *text_regex_new(void) {
+	Regex *r = calloc(1, sizeof(Regex));
+	if (!r)
+		return NULL;
+	r->source = (tre_str_source){
+		.get_next_char = str_next_char,
+		.rewind = str_rewind,
+		.compare = str_compare,
+		.context = r,
+	};
+	tre_regcomp(&r->regex, "\0\0", 0); /* this should not match anything */
+	return r;
+}
+
+int text_regex_compile(Regex *regex, const char *string, int cflags) {
+	tre_regfree(&regex->regex);
+	int r = tre_regcomp(&regex->regex, string, cflags);
+	if (r)
+		tre_regcomp(&regex->regex, "\0\0", 0);
+	free(regex->pattern);
+	regex->pattern = r ? NULL : strdup(string);
+	regex->cflags = r ? 0 : cflags;
+	regex->lines = !r && (cflags & REG_NEWLINE) && !strchr(string, '\n');
+	return r;
+}
+
+Regex *text_regex_dup(Regex *r) {
+	Regex *dup = text_regex_new();
+	if (dup && r->pattern && text_regex_compile(dup, r->pattern, r->cflags)) {
+		text_regex_free(dup);
+		return NULL;
+	}
+	return dup;
+}
+
+bool text_regex_lines(Regex *r) {
+	return r->lines;
+}
+
+size_t text_regex_length_max(Regex *r) {
+	(void)r;
+	return SIZE_MAX;
+}
+
+int text_regex_cflags(Regex *r) {
+	return r->cflags;
+}
+
+size_t text_regex_nsub(Regex *r) {
+	if (!r)
+		return 0;
+	return r->regex.re_nsub;
+}
+
+void text_regex_free(Regex *r) {
+	if (!r)
+		return;
+	tre_regfree(&r->regex);
+	free(r->pattern);
+	free(r);
+}
+
+int text_regex_match(Regex *r, const char *data, int eflags) {
+	return tre_regexec(&r->regex, data, 0, NULL, eflags);
+}
+
+int text_search_range_forward(Text *txt, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags) {
+	r->text = txt;
+	r->start = pos;
+	r->end = pos + len;
+	r->it = text_iterator_get(txt, pos);
+	regmatch_t match[nmatch];
+	int ret = tre_reguexec(&r->regex, &r->source, nmatch, match, eflags);
+	if (!ret) {
+		for (size_t i = 0; i < nmatch; i++) {
+			pmatch[i].start = match[i].rm_so == -1 ? EPOS : pos + match[i].rm_so;
+			pmatch[i].end = match[i].rm_eo == -1 ? EPOS : pos + match[i].rm_eo;
+		}
+	}
+	return ret;
+}
+
+/* last match within [pos, end) found by repeated forward searches */
+static int search_backward(Text *txt, size_t pos, size_t end, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags) {
+	int ret = REG_NOMATCH;
+	RegexMatch match[MAX(nmatch, 1)];
+	for (int flags = eflags; pos < end && !text_search_range_forward(txt, pos, end - pos, r, MAX(nmatch, 1), match, flags); ) {
+		ret = 0;
+		memcpy(pmatch, match, nmatch * sizeof *pmatch);
+		size_t next = match[0].end;
+		if (next == match[0].start) {
+			/* empty match, advance to next line */
+			next = text_line_next(txt, next);
+			if (next <= match[0].start)
+				break;
+		}
+		pos = next;
+		/* ^ only matches after a new line and only if REG_NEWLINE is set */
+		char prev;
+		if ((r->cflags & REG_NEWLINE) && text_byte_get(txt, pos - 1, &prev) && prev == '\n')
+			flags = eflags & ~REG_NOTBOL;
+		else
+			flags = eflags | REG_NOTBOL;
+	}
+	return ret;
+}
+
+size_t text_search_all(Text *txt, size_t pos, size_t len, Regex *r, size_t nmatch, int eflags, bool (*visit)(const RegexMatch pmatch[], size_t nmatch, void *data), void *data) {
+	size_t end = pos + len, count = 0;
+	RegexMatch match[MAX(nmatch, 1)];
+	for (int flags = eflags; pos <= end && !text_search_range_forward(txt, pos, end - pos, r, MAX(nmatch, 1), match, flags); ) {
+		count++;
+		if (visit && !visit(match, nmatch, data))
+			break;
+		pos = match[0].end;
+		if (match[0].start == match[0].end) {
+			/* continue after the character following an empty match */
+			if (pos == end)
+				break;
+			pos = text_char_next(txt, pos);
+		}
+		char prev;
+		if ((r->cflags & REG_NEWLINE) && text_byte_get(txt, pos - 1, &prev) && prev == '\n')
+			flags = eflags & ~REG_NOTBOL;
+		else
+			flags = eflags | REG_NOTBOL;
+	}
+	return count;
+}
+
+/* if matches do not span lines, line aligned windows of the range are
+ * searched starting from its end, the first one containing a match holds
+ * the last one of the whole range */
+int text_search_range_backward(Text *txt, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags) {
+	size_t start = pos, end = pos + len;
+	for (size_t next = end; next > start; next = pos) {
+		pos = start;
+		if (r->lines && next - start > REGEX_WINDOW)
+			pos = MAX(start, text_line_begin(txt, next - REGEX_WINDOW));
+		int flags = pos == start ? eflags : eflags & ~REG_NOTBOL;
+		if (next < end)
+			flags |= REG_NOTEOL;
+		if (!search_backward(txt, pos, next, r, nmatch, pmatch, flags))
+			return 0;
+	}
+	return REG_NOMATCH;
+}
+
+#endif
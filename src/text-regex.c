@@ -1,12 +1,116 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* memrchr(3) is non-standard */
+#endif
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 #include "text-regex.h"
+#include "text-motions.h"
+#include "util.h"
+
+#if !CONFIG_TRE
+
+#if CONFIG_REGEX_DFA
+#include "text-regex-dfa.h"
+#endif
 
 struct Regex {
 	regex_t regex;
+	char *pattern;  /* source of the compiled expression */
+	int cflags;
+	bool lines;     /* matches never contain a new line */
+	size_t length;  /* upper bound of the match length, SIZE_MAX if unknown */
+#if CONFIG_REGEX_DFA
+	RegexDfa *dfa;  /* built-in engine used if no submatches are requested */
+#endif
 };
 
+/* maximal nesting of groups considered by pattern_length */
+#define LENGTH_DEPTH 32
+
+/* upper bound of the length in bytes of a match, SIZE_MAX if unbounded.
+ * alternatives are summed up instead of taking the longest one, anchors
+ * count as characters and some literal characters are taken for repetition
+ * operators. the bound is thus not tight but never too small */
+static size_t pattern_length(const char *pattern, int cflags) {
+	const unsigned char *s = (const unsigned char*)pattern;
+	bool extended = cflags & REG_EXTENDED;
+	size_t mb = MB_CUR_MAX;
+	size_t sum[LENGTH_DEPTH] = { 0 }; /* lengths of the enclosing groups */
+	size_t last = 0;                  /* length of the preceding atom */
+	int depth = 0;
+	while (*s) {
+		unsigned char c = *s++;
+		bool escaped = c == '\\' && *s;
+		if (escaped)
+			c = *s++;
+		size_t atom = 0;
+		if (escaped == !extended && c == '(') {
+			if (++depth == LENGTH_DEPTH)
+				return SIZE_MAX;
+			sum[depth] = 0;
+			continue;
+		} else if (escaped == !extended && c == ')' && depth > 0) {
+			atom = sum[depth--];
+		} else if (escaped == !extended && c == '{' && (isdigit(*s) || *s == ',')) {
+			/* the preceding atom is repeated up to max times */
+			char *end;
+			unsigned long max = strtoul((const char*)s, &end, 10);
+			if (*end == ',') {
+				if (end[1] == '\\' || end[1] == '}')
+					return SIZE_MAX;
+				max = strtoul(end + 1, &end, 10);
+			}
+			if (max > 0 && last > SIZE_MAX / max)
+				return SIZE_MAX;
+			size_t len = max * last;
+			sum[depth] = sum[depth] - last + len;
+			last = len;
+			s = (const unsigned char*)end + (*end == '\\') + (*end != '\0');
+			continue;
+		} else if (c == '*' || (c == '+' && escaped == !extended)) {
+			return SIZE_MAX;
+		} else if (escaped && c >= '1' && c <= '9') {
+			return SIZE_MAX; /* back reference */
+		} else if ((c == '?' || c == '|') && escaped == !extended) {
+			continue;
+		} else if (!escaped && c == '[') {
+			/* bracket expression, a literal ] might come first */
+			if (*s == '^')
+				s++;
+			if (*s == ']')
+				s++;
+			while (*s && *s != ']') {
+				if (*s == '[' && (s[1] == ':' || s[1] == '.' || s[1] == '=')) {
+					const char *end = strstr((const char*)s + 2, (const char[]){ s[1], ']', '\0' });
+					if (!end)
+						return SIZE_MAX;
+					s = (const unsigned char*)end + 2;
+				} else {
+					s++;
+				}
+			}
+			if (*s)
+				s++;
+			atom = mb;
+		} else if (escaped || c == '.' || (cflags & REG_ICASE)) {
+			atom = mb;
+		} else {
+			/* a literal character, including all bytes of a multibyte one */
+			atom = 1;
+			while (mb > 1 && *s && !ISUTF8(*s)) {
+				s++;
+				atom++;
+			}
+		}
+		if (!addu(sum[depth], atom, &sum[depth]))
+			return SIZE_MAX;
+		last = atom;
+	}
+	return sum[0];
+}
+
 Regex *text_regex_new(void) {
 	Regex *r = calloc(1, sizeof(Regex));
 	if (!r)
@@ -16,12 +120,49 @@ Regex *text_regex_new(void) {
 }
 
 int text_regex_compile(Regex *regex, const char *string, int cflags) {
+#if CONFIG_REGEX_DFA
+	text_regex_dfa_free(regex->dfa);
+	regex->dfa = NULL;
+#endif
+	regfree(&regex->regex);
 	int r = regcomp(&regex->regex, string, cflags);
 	if (r)
 		regcomp(&regex->regex, "\0\0", 0);
+	/* with REG_NEWLINE neither . nor non-matching lists match a new line,
+	 * hence only a literal one could be part of a match */
+	free(regex->pattern);
+	regex->pattern = r ? NULL : strdup(string);
+	regex->cflags = r ? 0 : cflags;
+	regex->lines = !r && (cflags & REG_NEWLINE) && !strchr(string, '\n');
+	regex->length = r ? 0 : pattern_length(string, cflags);
+#if CONFIG_REGEX_DFA
+	if (regex->lines)
+		regex->dfa = text_regex_dfa_new(string, cflags);
+#endif
 	return r;
 }
 
+Regex *text_regex_dup(Regex *r) {
+	Regex *dup = text_regex_new();
+	if (dup && r->pattern && text_regex_compile(dup, r->pattern, r->cflags)) {
+		text_regex_free(dup);
+		return NULL;
+	}
+	return dup;
+}
+
+bool text_regex_lines(Regex *r) {
+	return r->lines;
+}
+
+size_t text_regex_length_max(Regex *r) {
+	return r->length;
+}
+
+int text_regex_cflags(Regex *r) {
+	return r->cflags;
+}
+
 size_t text_regex_nsub(Regex *r) {
 	if (!r)
 		return 0;
@@ -31,7 +172,11 @@ size_t text_regex_nsub(Regex *r) {
 void text_regex_free(Regex *r) {
 	if (!r)
 		return;
+#if CONFIG_REGEX_DFA
+	text_regex_dfa_free(r->dfa);
+#endif
 	regfree(&r->regex);
+	free(r->pattern);
 	free(r);
 }
 
@@ -39,15 +184,133 @@ int text_regex_match(Regex *r, const char *data, int eflags) {
 	return regexec(&r->regex, data, 0, NULL, eflags);
 }
 
-int text_search_range_forward(Text *txt, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags) {
-	char *buf = text_bytes_alloc0(txt, pos, len);
-	if (!buf)
+/* read the text starting at pos into a NUL terminated buffer which is grown
+ * as needed. at least min bytes are read, further bytes up to the end of the
+ * last complete line or end. returns the number of bytes read */
+static size_t window_read(Text *txt, size_t pos, size_t end, size_t min, char **buf, size_t *size) {
+	size_t len = 0;
+	for (;;) {
+		size_t want = MIN(min, end - pos - len);
+		if (len + want + 1 > *size) {
+			size_t new_size = MAX(2 * *size, len + want + 1);
+			char *new_buf = realloc(*buf, new_size);
+			if (!new_buf)
+				return 0;
+			*buf = new_buf;
+			*size = new_size;
+		}
+		size_t n = text_bytes_get(txt, pos + len, want, *buf + len);
+		const char *nl = memrchr(*buf + len, '\n', n);
+		len += n;
+		if (n < want || pos + len == end)
+			break;
+		if (nl) {
+			len = nl + 1 - *buf;
+			break;
+		}
+	}
+	(*buf)[len] = '\0';
+	return len;
+}
+
+/* execution flags for a match attempt at cur, unless it is the start of the
+ * buffer ^ should only match after a new line and only if REG_NEWLINE is set.
+ * $ does not match at the end of the buffer if the text continues after it,
+ * i.e. for attempts starting at or after tail (if any) */
+static int search_eflags(Regex *r, const char *buf, const char *cur, const char *tail, int eflags) {
+	if (tail && cur >= tail)
+		eflags |= REG_NOTEOL;
+	if (cur == buf)
+		return eflags;
+	if ((r->cflags & REG_NEWLINE) && cur[-1] == '\n')
+		return eflags & ~REG_NOTBOL;
+	return eflags | REG_NOTBOL;
+}
+
+/* regexec(3) on the NUL terminated string at cur. its end is cached in nul
+ * (which is NULL initially) and only looked up again once cur moved past it,
+ * passing it avoids a strlen(3) over the rest of the buffer on every call */
+static int search_exec(Regex *r, const char *buf, const char *cur, const char **nul, const char *tail, size_t nmatch, regmatch_t match[], int eflags) {
+	eflags = search_eflags(r, buf, cur, tail, eflags);
+#ifdef REG_STARTEND
+	if (nmatch > 0) {
+		if (!*nul || *nul < cur)
+			*nul = cur + strlen(cur);
+		match[0] = (regmatch_t){ .rm_so = 0, .rm_eo = *nul - cur };
+		eflags |= REG_STARTEND;
+	}
+#else
+	(void)nul;
+#endif
+	return regexec(&r->regex, cur, nmatch, match, eflags);
+}
+
+#if CONFIG_REGEX_DFA
+/* whether the built-in engine can report the requested matches within the
+ * len bytes of buf. it treats NUL bytes as ordinary characters, whereas the
+ * C library stops at them, such text is left to the latter for consistency */
+static bool search_dfa(Regex *r, const char *buf, size_t len, size_t nmatch) {
+	return r->dfa && (nmatch <= 1 || r->regex.re_nsub == 0) && !memchr(buf, '\0', len);
+}
+
+static void search_dfa_match(size_t pos, size_t start, size_t end, size_t nmatch, RegexMatch pmatch[]) {
+	for (size_t i = 0; i < nmatch; i++)
+		pmatch[i] = i == 0 ? (RegexMatch){ pos + start, pos + end } : (RegexMatch){ EPOS, EPOS };
+}
+
+/* attempts are made at positions before the end of the buffer, like the
+ * ones of the C library based searches below */
+static int search_dfa_forward(Regex *r, const char *buf, const char *tail, size_t pos, size_t len, size_t nmatch, RegexMatch pmatch[], int eflags) {
+	size_t start, end;
+	if (tail)
+		eflags |= REG_NOTEOL;
+	if (len == 0 || !text_regex_dfa_search(r->dfa, buf, len, 0, eflags, &start, &end))
+		return REG_NOMATCH;
+	/* an empty match at the end belongs to the following window */
+	if (tail && start == len)
 		return REG_NOMATCH;
-	char *cur = buf, *end = buf + len;
+	search_dfa_match(pos, start, end, nmatch, pmatch);
+	return 0;
+}
+
+static int search_dfa_backward(Regex *r, const char *buf, const char *tail, size_t pos, size_t len, size_t nmatch, RegexMatch pmatch[], int eflags) {
+	size_t cur = 0, start, end;
 	int ret = REG_NOMATCH;
-	regmatch_t match[nmatch];
+	if (tail)
+		eflags |= REG_NOTEOL;
+	while (cur < len && text_regex_dfa_search(r->dfa, buf, len, cur, eflags, &start, &end)) {
+		ret = 0;
+		search_dfa_match(pos, start, end, nmatch, pmatch);
+		if (start == cur && end == cur) {
+			/* empty match at cur, advance to next line */
+			const char *nl = memchr(buf + cur, '\n', len - cur);
+			if (!nl)
+				break;
+			cur = nl + 1 - buf;
+		} else {
+			cur = end;
+		}
+	}
+	return ret;
+}
+#endif
+
+/* search the len bytes of buf corresponding to text position pos */
+static int search_forward(Regex *r, const char *buf, const char *tail, size_t pos, size_t len, size_t nmatch, RegexMatch pmatch[], int eflags) {
+#if CONFIG_REGEX_DFA
+	if (search_dfa(r, buf, len, nmatch))
+		return search_dfa_forward(r, buf, tail, pos, len, nmatch, pmatch, eflags);
+#endif
+	const char *cur = buf, *end = buf + len;
+	int ret = REG_NOMATCH;
+	regmatch_t match[MAX(nmatch, 1)];
 	for (size_t junk = len; len > 0; len -= junk, pos += junk) {
-		ret = regexec(&r->regex, cur, nmatch, match, eflags);
+		ret = regexec(&r->regex, cur, MAX(nmatch, 1), match, search_eflags(r, buf, cur, tail, eflags));
+		if (!ret && tail && cur + match[0].rm_so == end) {
+			/* an empty match at the end belongs to the following window */
+			ret = REG_NOMATCH;
+			break;
+		}
 		if (!ret) {
 			for (size_t i = 0; i < nmatch; i++) {
 				pmatch[i].start = match[i].rm_so == -1 ? EPOS : pos + match[i].rm_so;
@@ -55,7 +318,7 @@ int text_search_range_forward(Text *txt, size_t pos, size_t len, Regex *r, size_
 			}
 			break;
 		}
-		char *next = memchr(cur, 0, len);
+		const char *next = memchr(cur, 0, len);
 		if (!next)
 			break;
 		while (!*next && next != end)
@@ -63,20 +326,20 @@ int text_search_range_forward(Text *txt, size_t pos, size_t len, Regex *r, size_
 		junk = next - cur;
 		cur = next;
 	}
-	free(buf);
 	return ret;
 }
 
-int text_search_range_backward(Text *txt, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags) {
-	char *buf = text_bytes_alloc0(txt, pos, len);
-	if (!buf)
-		return REG_NOMATCH;
-	char *cur = buf, *end = buf + len;
+static int search_backward(Regex *r, const char *buf, const char *tail, size_t pos, size_t len, size_t nmatch, RegexMatch pmatch[], int eflags) {
+#if CONFIG_REGEX_DFA
+	if (search_dfa(r, buf, len, nmatch))
+		return search_dfa_backward(r, buf, tail, pos, len, nmatch, pmatch, eflags);
+#endif
+	const char *cur = buf, *end = buf + len, *nul = NULL;
 	int ret = REG_NOMATCH;
 	regmatch_t match[nmatch];
 	for (size_t junk = len; len > 0; len -= junk, pos += junk) {
-		char *next;
-		if (!regexec(&r->regex, cur, nmatch, match, eflags)) {
+		const char *next;
+		if (!search_exec(r, buf, cur, &nul, tail, nmatch, match, eflags)) {
 			ret = 0;
 			for (size_t i = 0; i < nmatch; i++) {
 				pmatch[i].start = match[i].rm_so == -1 ? EPOS : pos + match[i].rm_so;
@@ -85,7 +348,7 @@ int text_search_range_backward(Text *txt, size_t pos, size_t len, Regex *r, size
 
 			if (match[0].rm_so == 0 && match[0].rm_eo == 0) {
 				/* empty match at the beginning of cur, advance to next line */
-				next = strchr(cur, '\n');
+				next = memchr(cur, '\n', len);
 				if (!next)
 					break;
 				next++;
@@ -102,6 +365,154 @@ int text_search_range_backward(Text *txt, size_t pos, size_t len, Regex *r, size
 		junk = next - cur;
 		cur = next;
 	}
+	return ret;
+}
+
+/* unless matches can span lines, the range is searched in line aligned
+ * windows of bounded size instead of being copied at once. windows other
+ * than the last one of the range (which ends at stop) end with a new line,
+ * a $ anchor matches before it anyway */
+static int search_window(Text *txt, size_t pos, size_t end, size_t stop, size_t min, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags, bool forward, char **buf, size_t *size, size_t *len) {
+	size_t n = window_read(txt, pos, end, min, buf, size);
+	*len = n;
+	if (n == 0)
+		return REG_NOMATCH;
+	const char *tail = NULL;
+	if (pos + n < stop) {
+		const char *nul = memrchr(*buf, '\0', n);
+		tail = nul ? nul + 1 : *buf;
+	}
+	if (forward)
+		return search_forward(r, *buf, tail, pos, n, nmatch, pmatch, eflags);
+	return search_backward(r, *buf, tail, pos, n, nmatch, pmatch, eflags);
+}
+
+int text_search_range_forward(Text *txt, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags) {
+	size_t end = pos + len, size = 0, n;
+	size_t min = r->lines ? REGEX_WINDOW : len;
+	char *buf = NULL;
+	int ret = REG_NOMATCH;
+	for (; pos < end && ret; pos += n) {
+		ret = search_window(txt, pos, end, end, min, r, nmatch, pmatch, eflags, true, &buf, &size, &n);
+		if (n == 0)
+			break;
+		eflags &= ~REG_NOTBOL;
+	}
 	free(buf);
 	return ret;
 }
+
+/* first match at or after offset cur <= len of the len bytes of buf, offsets
+ * in match are relative to buf. match has to provide room for nmatch > 0.
+ * dfa tells whether the built-in engine is used, see search_dfa */
+static bool search_next(Regex *r, bool dfa, const char *buf, const char *tail, const char **nul, size_t len, size_t cur, size_t nmatch, regmatch_t match[], int eflags) {
+#if CONFIG_REGEX_DFA
+	if (dfa) {
+		size_t start, end;
+		if (!text_regex_dfa_search(r->dfa, buf, len, cur, tail ? eflags | REG_NOTEOL : eflags, &start, &end))
+			return false;
+		for (size_t i = 0; i < nmatch; i++)
+			match[i] = i == 0 ? (regmatch_t){ start, end } : (regmatch_t){ -1, -1 };
+		return true;
+	}
+#else
+	(void)dfa;
+#endif
+	while (cur <= len) {
+		if (!search_exec(r, buf, buf + cur, nul, tail, nmatch, match, eflags)) {
+			for (size_t i = 0; i < nmatch; i++) {
+				if (match[i].rm_so != -1) {
+					match[i].rm_so += cur;
+					match[i].rm_eo += cur;
+				}
+			}
+			return true;
+		}
+		const char *next = memchr(buf + cur, 0, len - cur);
+		if (!next)
+			break;
+		while (!*next && next != buf + len)
+			next++;
+		cur = next - buf;
+	}
+	return false;
+}
+
+/* report the matches within the len bytes of buf corresponding to text
+ * position pos, returns false if visit asked to stop */
+static bool search_all(Regex *r, const char *buf, const char *tail, size_t pos, size_t len, size_t nmatch, int eflags, bool (*visit)(const RegexMatch[], size_t, void*), void *data, size_t *count) {
+	regmatch_t match[MAX(nmatch, 1)];
+	RegexMatch pmatch[MAX(nmatch, 1)];
+	const char *nul = NULL;
+	bool dfa = false;
+#if CONFIG_REGEX_DFA
+	dfa = search_dfa(r, buf, len, nmatch);
+#endif
+	for (size_t cur = 0; (cur < len || (cur == len && !tail)) && search_next(r, dfa, buf, tail, &nul, len, cur, MAX(nmatch, 1), match, eflags); ) {
+		/* an empty match at the end belongs to the following window */
+		if (tail && (size_t)match[0].rm_so == len)
+			break;
+		for (size_t i = 0; i < nmatch; i++) {
+			pmatch[i].start = match[i].rm_so == -1 ? EPOS : pos + match[i].rm_so;
+			pmatch[i].end = match[i].rm_eo == -1 ? EPOS : pos + match[i].rm_eo;
+		}
+		(*count)++;
+		if (visit && !visit(pmatch, nmatch, data))
+			return false;
+		cur = match[0].rm_eo;
+		if (match[0].rm_so == match[0].rm_eo) {
+			/* continue after the character following an empty match, stray
+			 * continuation bytes count as characters of their own */
+			bool lead = cur < len && (unsigned char)buf[cur] >= 0xC0;
+			cur++;
+			while (lead && cur < len && !ISUTF8(buf[cur]))
+				cur++;
+		}
+	}
+	return true;
+}
+
+size_t text_search_all(Text *txt, size_t pos, size_t len, Regex *r, size_t nmatch, int eflags, bool (*visit)(const RegexMatch pmatch[], size_t nmatch, void *data), void *data) {
+	size_t end = pos + len, size = 0, count = 0;
+	size_t min = r->lines ? REGEX_WINDOW : len;
+	char *buf = NULL;
+	/* an empty range is searched as well, it might hold an empty match */
+	for (size_t n; ; pos += n) {
+		n = window_read(txt, pos, end, min, &buf, &size);
+		if (!buf || (n == 0 && pos < end))
+			break;
+		const char *tail = NULL;
+		if (pos + n < end) {
+			const char *nul = memrchr(buf, '\0', n);
+			tail = nul ? nul + 1 : buf;
+		}
+		if (!search_all(r, buf, tail, pos, n, nmatch, eflags, visit, data, &count) || pos + n == end)
+			break;
+		eflags &= ~REG_NOTBOL;
+	}
+	free(buf);
+	return count;
+}
+
+/* the windows are processed from the end of the range, each one starts at
+ * the beginning of the line REGEX_WINDOW bytes before the previous one.
+ * matches do not span lines, hence the last match within the first window
+ * containing any is the last one of the whole range */
+int text_search_range_backward(Text *txt, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags) {
+	size_t start = pos, end = pos + len, size = 0, n;
+	char *buf = NULL;
+	int ret = REG_NOMATCH;
+	for (size_t next = end; next > start && ret; next = pos) {
+		pos = start;
+		if (r->lines && next - start > REGEX_WINDOW)
+			pos = MAX(start, text_line_begin(txt, next - REGEX_WINDOW));
+		int flags = pos == start ? eflags : eflags & ~REG_NOTBOL;
+		ret = search_window(txt, pos, next, end, next - pos, r, nmatch, pmatch, flags, false, &buf, &size, &n);
+		if (n == 0)
+			break;
+	}
+	free(buf);
+	return ret;
+}
+
+#endif
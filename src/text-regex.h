@@ -9,15 +9,38 @@
 #endif
 #include "text.h"
 
+/* minimal number of bytes searched at a time if matches can not span lines */
+#ifndef REGEX_WINDOW
+#define REGEX_WINDOW (1 << 20)
+#endif
+
+/* search patterns whose matches do not span lines with the built-in engine */
+#ifndef CONFIG_REGEX_DFA
+#define CONFIG_REGEX_DFA 1
+#endif
+
 typedef struct Regex Regex;
 typedef Filerange RegexMatch;
 
 Regex *text_regex_new(void);
 int text_regex_compile(Regex*, const char *pattern, int cflags);
+/* compile the same pattern again, the copy can be used concurrently */
+Regex *text_regex_dup(Regex*);
+/* whether matches are known to never contain a new line */
+bool text_regex_lines(Regex*);
+/* upper bound of the length in bytes of a match, SIZE_MAX if unknown */
+size_t text_regex_length_max(Regex*);
+/* compilation flags of the expression */
+int text_regex_cflags(Regex*);
 size_t text_regex_nsub(Regex*);
 void text_regex_free(Regex*);
 int text_regex_match(Regex*, const char *data, int eflags);
 int text_search_range_forward(Text*, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags);
 int text_search_range_backward(Text*, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags);
+/* report all non-overlapping matches within the range in a single pass, in
+ * order of their position. after an empty match the search continues at the
+ * next character. visit (unless NULL) is called for every match, returning
+ * false stops the search. returns the number of reported matches */
+size_t text_search_all(Text*, size_t pos, size_t len, Regex *r, size_t nmatch, int eflags, bool (*visit)(const RegexMatch pmatch[], size_t nmatch, void *data), void *data);
 
 #endif
@@ -0,0 +1,103 @@
+/* measures text_search_range_forward_parallel with an increasing number of
+ * threads on a generated log file, the only match is on its last line such
+ * that the whole range is searched. run `make bench`, optionally followed by
+ * `./text-search-bench [size in MB] [maximal number of threads]` */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "text.h"
+#include "text-regex.h"
+#include "text-search.h"
+
+static const char *patterns[] = {
+	"upstream timeout",           /* skipped using the required literal */
+	"[a-z]+=[0-9]+ [A-Z]{5}$",    /* every line is run through the DFA */
+};
+
+static bool generate(FILE *file, size_t size) {
+	const char *levels[] = { "INFO", "WARN", "DEBUG" };
+	const char *paths[] = { "/api/v1/items", "/api/v1/users", "/static/app.js", "/health" };
+	unsigned int seed = 1;
+	for (size_t len = 0, line = 0; len < size; line++) {
+		int n = fprintf(file, "2024-01-01T%02zu:%02zu:%02zu %s request handled in %dms status=%d path=%s\n",
+		                line / 3600 % 24, line / 60 % 60, line % 60, levels[rand_r(&seed) % 3],
+		                rand_r(&seed) % 1000, 200 + rand_r(&seed) % 4 * 100, paths[rand_r(&seed) % 4]);
+		if (n < 0)
+			return false;
+		len += n;
+	}
+	return fprintf(file, "2024-01-02T00:00:00 ERROR upstream timeout retries=3 ABORT\n") > 0;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+	size_t size = (argc > 1 ? strtoul(argv[1], NULL, 10) : 256) << 20;
+	int max = argc > 2 ? atoi(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+	if (max < 1)
+		max = 1;
+
+	char filename[32] = "/tmp/vis-bench-XXXXXX";
+	int fd = mkstemp(filename);
+	FILE *file = fd == -1 ? NULL : fdopen(fd, "w");
+	if (!file) {
+		fprintf(stderr, "failed to create temporary file\n");
+		return 1;
+	}
+	bool generated = generate(file, size);
+	if (fclose(file) == EOF || !generated) {
+		unlink(filename);
+		fprintf(stderr, "failed to generate %s\n", filename);
+		return 1;
+	}
+	Text *txt = text_load(filename);
+	unlink(filename);
+	if (!txt) {
+		fprintf(stderr, "failed to load %s\n", filename);
+		return 1;
+	}
+
+	/* wait for the content statistics gathered in the background */
+	text_profile(txt, true);
+	printf("%zu MB, %ld online processors\n", text_size(txt) >> 20, sysconf(_SC_NPROCESSORS_ONLN));
+	int ret = 0;
+	for (size_t i = 0; i < sizeof patterns / sizeof *patterns; i++) {
+		Regex *r = text_regex_new();
+		if (!r || text_regex_compile(r, patterns[i], REG_EXTENDED|REG_NEWLINE)) {
+			text_regex_free(r);
+			ret = 1;
+			continue;
+		}
+		printf("\n%s\n", patterns[i]);
+		/* the first search faults the pages of the file in */
+		RegexMatch expected[1];
+		text_search_range_forward(txt, 0, text_size(txt), r, 1, expected, 0);
+		double base = now();
+		if (text_search_range_forward(txt, 0, text_size(txt), r, 1, expected, 0))
+			expected[0] = (RegexMatch){ EPOS, EPOS };
+		base = now() - base;
+		printf("     serial: %8.3fs\n", base);
+		for (int threads = 1; threads <= max; threads++) {
+			RegexMatch match[1] = { { EPOS, EPOS } };
+			double start = now();
+			text_search_range_forward_parallel(txt, 0, text_size(txt), r, 1, match, 0, threads);
+			double time = now() - start;
+			if (match[0].start != expected[0].start || match[0].end != expected[0].end) {
+				printf("%3d threads: wrong match\n", threads);
+				ret = 1;
+				continue;
+			}
+			printf("%3d threads: %8.3fs %6.2fx\n", threads, time, base / time);
+		}
+		text_regex_free(r);
+	}
+	text_free(txt);
+	return ret;
+}
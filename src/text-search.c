@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "text-search.h"
+#include "text-motions.h"
+#include "util.h"
+
+/* maximal number of threads searching a range */
+#ifndef SEARCH_THREADS
+#define SEARCH_THREADS 64
+#endif
+
+/* state shared by the threads searching a range, chunks are handed out in
+ * order hence once one of them holds a match, all preceding ones are either
+ * done or being searched */
+typedef struct {
+	Text *txt;
+	size_t start, end;      /* searched range */
+	size_t nmatch;
+	int eflags;
+	pthread_mutex_t lock;   /* protects the fields below */
+	size_t next;            /* index of the next chunk to search */
+	size_t found;           /* index of the first chunk holding a match */
+	RegexMatch *pmatch;     /* matches within chunk found */
+} Search;
+
+typedef struct {
+	Search *search;
+	Regex *regex;           /* copy of the expression private to the thread */
+	pthread_t thread;
+} Worker;
+
+/* first line begin at or after pos within the searched range */
+static size_t chunk_align(Search *s, size_t pos) {
+	char c;
+	if (pos <= s->start)
+		return s->start;
+	if (pos >= s->end)
+		return s->end;
+	if (text_byte_get(s->txt, pos - 1, &c) && c == '\n')
+		return pos;
+	return MIN(s->end, text_line_next(s->txt, pos));
+}
+
+static void *search_thread(void *arg) {
+	Worker *w = arg;
+	Search *s = w->search;
+	RegexMatch match[MAX(s->nmatch, 1)];
+	for (;;) {
+		pthread_mutex_lock(&s->lock);
+		size_t i = s->next;
+		bool done = i >= s->found;
+		if (!done)
+			s->next++;
+		pthread_mutex_unlock(&s->lock);
+		if (done)
+			break;
+		/* matches do not span lines, hence chunks need not overlap */
+		size_t start = chunk_align(s, s->start + i * SEARCH_CHUNK);
+		size_t end = chunk_align(s, s->start + (i + 1) * SEARCH_CHUNK);
+		if (start == end)
+			continue;
+		int eflags = s->eflags;
+		if (start > s->start)
+			eflags &= ~REG_NOTBOL;
+		if (end < s->end)
+			eflags |= REG_NOTEOL;
+		if (text_search_range_forward(s->txt, start, end - start, w->regex, MAX(s->nmatch, 1), match, eflags))
+			continue;
+		/* an empty match at the end belongs to the following chunk */
+		if (end < s->end && match[0].start == end)
+			continue;
+		pthread_mutex_lock(&s->lock);
+		if (i < s->found) {
+			s->found = i;
+			memcpy(s->pmatch, match, s->nmatch * sizeof *match);
+		}
+		pthread_mutex_unlock(&s->lock);
+		break;
+	}
+	return NULL;
+}
+
+int text_search_range_forward_parallel(Text *txt, size_t pos, size_t len, Regex *r, size_t nmatch, RegexMatch pmatch[], int eflags, int threads) {
+	size_t chunks = len / SEARCH_CHUNK + (len % SEARCH_CHUNK != 0);
+	if (threads <= 0)
+		threads = SEARCH_THREADS_DEFAULT;
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	threads = MIN(threads, SEARCH_THREADS);
+	if ((size_t)threads > chunks)
+		threads = chunks;
+	if (threads < 2 || !text_regex_lines(r))
+		return text_search_range_forward(txt, pos, len, r, nmatch, pmatch, eflags);
+
+	Search s = {
+		.txt = txt,
+		.start = pos,
+		.end = pos + len,
+		.nmatch = nmatch,
+		.eflags = eflags,
+		.found = chunks,
+		.pmatch = pmatch,
+	};
+	pthread_mutex_init(&s.lock, NULL);
+	/* the calling thread searches as well, using the original expression */
+	Worker workers[threads];
+	workers[0] = (Worker){ .search = &s, .regex = r };
+	int started = 1;
+	for (; started < threads; started++) {
+		Worker *w = &workers[started];
+		*w = (Worker){ .search = &s, .regex = text_regex_dup(r) };
+		if (!w->regex)
+			break;
+		if (pthread_create(&w->thread, NULL, search_thread, w)) {
+			text_regex_free(w->regex);
+			break;
+		}
+	}
+	search_thread(&workers[0]);
+	for (int i = 1; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		text_regex_free(workers[i].regex);
+	}
+	pthread_mutex_destroy(&s.lock);
+	return s.found < chunks ? 0 : REG_NOMATCH;
+}
+
+/* growing array of match ranges */
+typedef struct {
+	RegexMatch *data;
+	size_t count, size;
+	bool error;             /* memory allocation failed */
+} Matches;
+
+static bool matches_add(const RegexMatch pmatch[], size_t nmatch, void *data) {
+	Matches *m = data;
+	(void)nmatch;
+	if (m->count == m->size) {
+		size_t size = MAX(2 * m->size, 1024);
+		RegexMatch *matches = realloc(m->data, size * sizeof *matches);
+		if (!matches) {
+			m->error = true;
+			return false;
+		}
+		m->data = matches;
+		m->size = size;
+	}
+	m->data[m->count++] = pmatch[0];
+	return true;
+}
+
+/* hand out the matches, shrinking the array to its final size */
+static void matches_get(Matches *m, RegexMatch **matches, size_t *count) {
+	if (!matches) {
+		free(m->data);
+		return;
+	}
+	RegexMatch *data = m->count ? realloc(m->data, m->count * sizeof *data) : NULL;
+	if (!data) {
+		data = m->data;
+		if (!m->count) {
+			free(data);
+			data = NULL;
+		}
+	}
+	*matches = data;
+	*count = m->count;
+}
+
+bool text_search_all_array(Text *txt, size_t pos, size_t len, Regex *r, int eflags, RegexMatch **matches, size_t *count) {
+	Matches m = { 0 };
+	text_search_all(txt, pos, len, r, 1, eflags, matches_add, &m);
+	if (m.error) {
+		free(m.data);
+		return false;
+	}
+	matches_get(&m, matches, count);
+	return true;
+}
+
+struct SearchAll {
+	Text *view;             /* content at the time the search was started */
+	Regex *regex;           /* copy of the expression */
+	size_t pos, len;        /* searched range */
+	int eflags;
+	pthread_t thread;
+	Matches matches;        /* only accessed by the thread until it is joined */
+	atomic_size_t count;    /* number of matches found so far */
+	atomic_bool cancel;     /* whether the search should stop early */
+	atomic_bool done;       /* whether the thread has finished */
+	bool complete;          /* whether the whole range was searched */
+};
+
+static bool search_all_visit(const RegexMatch pmatch[], size_t nmatch, void *data) {
+	SearchAll *s = data;
+	if (atomic_load(&s->cancel) || !matches_add(pmatch, nmatch, &s->matches))
+		return false;
+	atomic_store(&s->count, s->matches.count);
+	return true;
+}
+
+static void *search_all_thread(void *arg) {
+	SearchAll *s = arg;
+	text_search_all(s->view, s->pos, s->len, s->regex, 1, s->eflags, search_all_visit, s);
+	s->complete = !atomic_load(&s->cancel) && !s->matches.error;
+	atomic_store(&s->done, true);
+	return NULL;
+}
+
+SearchAll *text_search_all_start(Text *txt, size_t pos, size_t len, Regex *r, int eflags) {
+	SearchAll *s = calloc(1, sizeof *s);
+	if (!s)
+		return NULL;
+	s->view = text_view(txt);
+	s->regex = text_regex_dup(r);
+	s->pos = pos;
+	s->len = len;
+	s->eflags = eflags;
+	if (!s->view || !s->regex || pthread_create(&s->thread, NULL, search_all_thread, s)) {
+		text_regex_free(s->regex);
+		text_free(s->view);
+		free(s);
+		return NULL;
+	}
+	return s;
+}
+
+size_t text_search_all_count(SearchAll *s) {
+	return atomic_load(&s->count);
+}
+
+bool text_search_all_done(SearchAll *s) {
+	return atomic_load(&s->done);
+}
+
+bool text_search_all_finish(SearchAll *s, bool cancel, RegexMatch **matches, size_t *count) {
+	if (cancel)
+		atomic_store(&s->cancel, true);
+	pthread_join(s->thread, NULL);
+	bool complete = s->complete;
+	matches_get(&s->matches, matches, count);
+	text_regex_free(s->regex);
+	text_free(s->view);
+	free(s);
+	return complete;
+}
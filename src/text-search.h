@@ -0,0 +1,49 @@
+#ifndef TEXT_SEARCH_H
+#define TEXT_SEARCH_H
+
+/* regular expression searches running on other threads. unless stated
+ * otherwise the text must not be modified while a search is in progress. */
+
+#include <stddef.h>
+#include "text.h"
+#include "text-regex.h"
+
+/* size of the line aligned chunks searched by a thread at a time */
+#ifndef SEARCH_CHUNK
+#define SEARCH_CHUNK (4 << 20)
+#endif
+
+/* number of threads used if none are requested, 0 stands for one per online
+ * processor. searching on several threads has yet to show a speedup, see
+ * `make bench`, hence it is disabled by default */
+#ifndef SEARCH_THREADS_DEFAULT
+#define SEARCH_THREADS_DEFAULT 1
+#endif
+
+/* same as text_search_range_forward, but the range is split into chunks
+ * which are searched by up to threads threads (SEARCH_THREADS_DEFAULT if
+ * threads is 0). chunks following the one holding the first match are
+ * not searched anymore. small ranges and patterns whose matches might span
+ * lines are searched on the calling thread */
+int text_search_range_forward_parallel(Text*, size_t pos, size_t len, Regex*, size_t nmatch, RegexMatch pmatch[], int eflags, int threads);
+
+/* store the ranges of all matches found by text_search_all in a newly
+ * allocated array which has to be freed by the caller */
+bool text_search_all_array(Text*, size_t pos, size_t len, Regex*, int eflags, RegexMatch **matches, size_t *count);
+
+typedef struct SearchAll SearchAll;
+
+/* collect all matches in the background, the search operates on a view of
+ * the current text content (see text_view) and a copy of the expression,
+ * hence both can be modified or freed meanwhile. it has to be finished
+ * before the text is freed */
+SearchAll *text_search_all_start(Text*, size_t pos, size_t len, Regex*, int eflags);
+/* number of matches found so far */
+size_t text_search_all_count(SearchAll*);
+bool text_search_all_done(SearchAll*);
+/* wait for the search to complete, or stop it early if cancel is set, and
+ * release it. the matches found are stored as by text_search_all_array unless
+ * matches is NULL. returns whether the whole range was searched */
+bool text_search_all_finish(SearchAll*, bool cancel, RegexMatch **matches, size_t *count);
+
+#endif
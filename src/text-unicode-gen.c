@@ -0,0 +1,66 @@
+/* generates the display width table used by text-unicode.c from the
+ * wcwidth(3) implementation of the C library's C.UTF-8 locale, run
+ * `make unicode` to regenerate text-unicode-width.h */
+#define _XOPEN_SOURCE 700
+#include <locale.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+#define UNICODE_MAX 0x10FFFF
+#define BLOCKS ((UNICODE_MAX + 1) >> 8)
+
+static unsigned char blocks[BLOCKS][64];
+static unsigned int block_index[BLOCKS];
+
+int main(void) {
+	const char *locales[] = { "C.UTF-8", "C.utf8", "en_US.UTF-8" };
+	const char *locale = NULL;
+	for (size_t i = 0; !locale && i < sizeof locales / sizeof *locales; i++)
+		locale = setlocale(LC_CTYPE, locales[i]);
+	if (!locale) {
+		fprintf(stderr, "no UTF-8 locale available\n");
+		return 1;
+	}
+
+	size_t count = 0;
+	for (unsigned int b = 0; b < BLOCKS; b++) {
+		unsigned char block[64] = { 0 };
+		for (unsigned int i = 0; i < 256; i++) {
+			unsigned int cp = b << 8 | i;
+			/* surrogates are never decoded, keep them non-printable */
+			int w = 0xD800 <= cp && cp <= 0xDFFF ? -1 : wcwidth(cp);
+			unsigned int v = w < 0 || w > 2 ? 3 : w;
+			block[i >> 2] |= v << ((i & 3) * 2);
+		}
+		size_t j;
+		for (j = 0; j < count; j++) {
+			if (!memcmp(blocks[j], block, sizeof block))
+				break;
+		}
+		if (j == count)
+			memcpy(blocks[count++], block, sizeof block);
+		block_index[b] = j;
+	}
+
+	if (count > 256) {
+		fprintf(stderr, "too many distinct blocks: %zu\n", count);
+		return 1;
+	}
+
+	printf("/* generated by text-unicode-gen.c from the %s locale, do not edit */\n\n", locale);
+	printf("#define UNICODE_MAX 0x%X\n\n", UNICODE_MAX);
+	printf("static const unsigned char unicode_width_index[%d] = {", BLOCKS);
+	for (unsigned int b = 0; b < BLOCKS; b++)
+		printf("%s%u,", b % 16 ? " " : "\n\t", block_index[b]);
+	printf("\n};\n\n");
+	printf("static const unsigned char unicode_width_blocks[%zu][64] = {\n", count);
+	for (size_t j = 0; j < count; j++) {
+		printf("\t{");
+		for (unsigned int i = 0; i < 64; i++)
+			printf("%s0x%02x,", i % 16 ? " " : "\n\t\t", blocks[j][i]);
+		printf("\n\t},\n");
+	}
+	printf("};\n");
+	return 0;
+}
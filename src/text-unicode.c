@@ -0,0 +1,111 @@
+#include <string.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "text-unicode.h"
+#include "text-unicode-width.h"
+
+size_t text_utf8_decode(uint32_t *cp, const char *str, size_t len) {
+	const unsigned char *s = (const unsigned char*)str;
+	if (len == 0)
+		return (size_t)-2;
+	unsigned char c = s[0];
+	if (c < 0x80) {
+		*cp = c;
+		return c ? 1 : 0;
+	}
+
+	/* valid range of the second byte, excludes overlong forms,
+	 * surrogates and codepoints beyond U+10FFFF */
+	unsigned char lo = 0x80, hi = 0xBF;
+	uint32_t v;
+	size_t n;
+	if (c < 0xC2) {
+		return (size_t)-1;
+	} else if (c < 0xE0) {
+		n = 2;
+		v = c & 0x1F;
+	} else if (c < 0xF0) {
+		n = 3;
+		v = c & 0x0F;
+		if (c == 0xE0)
+			lo = 0xA0;
+		else if (c == 0xED)
+			hi = 0x9F;
+	} else if (c < 0xF5) {
+		n = 4;
+		v = c & 0x07;
+		if (c == 0xF0)
+			lo = 0x90;
+		else if (c == 0xF4)
+			hi = 0x8F;
+	} else {
+		return (size_t)-1;
+	}
+
+	for (size_t i = 1; i < n; i++) {
+		if (i == len)
+			return (size_t)-2;
+		unsigned char b = s[i];
+		if (b < lo || b > hi)
+			return (size_t)-1;
+		lo = 0x80;
+		hi = 0xBF;
+		v = (v << 6) | (b & 0x3F);
+	}
+
+	*cp = v;
+	return n;
+}
+
+int text_unicode_width(uint32_t cp) {
+	if (0x20 <= cp && cp < 0x7F)
+		return 1;
+	if (cp > UNICODE_MAX)
+		return -1;
+	/* two stage lookup: the high bits select a block of 256 codepoints,
+	 * within it each width is stored in 2 bits, 3 denoting -1 */
+	const unsigned char *block = unicode_width_blocks[unicode_width_index[cp >> 8]];
+	int w = (block[(cp & 0xFF) >> 2] >> ((cp & 3) * 2)) & 3;
+	return w == 3 ? -1 : w;
+}
+
+/* bytes of x which are non-ASCII, control characters or DEL */
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+#define ASCII_NONPRINTABLE(x) (((x) | (((x) - 0x20*ONES) & ~(x)) | \
+	((((x) ^ 0x7F*ONES) - ONES) & ~((x) ^ 0x7F*ONES))) & HIGHS)
+
+size_t text_ascii_span(const char *str, size_t len) {
+	const unsigned char *s = (const unsigned char*)str, *end = s + len;
+#if defined(__AVX2__)
+	const __m256i ctrl32 = _mm256_set1_epi8(0x1F), del32 = _mm256_set1_epi8(0x7F);
+	for (; end - s >= 32; s += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)s);
+		/* signed comparison, bytes >= 0x80 are negative */
+		__m256i ok = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, del32), _mm256_cmpgt_epi8(v, ctrl32));
+		uint32_t mask = _mm256_movemask_epi8(ok);
+		if (mask != UINT32_MAX)
+			return s - (const unsigned char*)str + __builtin_ctz(~mask);
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i ctrl = _mm_set1_epi8(0x1F), del = _mm_set1_epi8(0x7F);
+	for (; end - s >= 16; s += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)s);
+		__m128i ok = _mm_andnot_si128(_mm_cmpeq_epi8(v, del), _mm_cmpgt_epi8(v, ctrl));
+		unsigned int mask = _mm_movemask_epi8(ok);
+		if (mask != 0xFFFF)
+			return s - (const unsigned char*)str + __builtin_ctz(~mask);
+	}
+#endif
+	for (; end - s >= 8; s += 8) {
+		uint64_t x;
+		memcpy(&x, s, sizeof x);
+		if (ASCII_NONPRINTABLE(x))
+			break;
+	}
+	while (s < end && 0x20 <= *s && *s < 0x7F)
+		s++;
+	return s - (const unsigned char*)str;
+}
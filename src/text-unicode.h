@@ -0,0 +1,25 @@
+#ifndef TEXT_UNICODE_H
+#define TEXT_UNICODE_H
+
+/* locale independent UTF-8 decoding and display width lookup */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* maximal length of an UTF-8 encoded codepoint */
+#define UTF8_LEN_MAX 4
+
+/* decode the codepoint encoded in at most len bytes of str, mirroring
+ * mbrtowc(3) in an UTF-8 locale: returns the number of bytes consumed,
+ * 0 for the NUL byte, (size_t)-2 if the sequence is incomplete and
+ * (size_t)-1 if it is invalid (overlong forms and surrogates included) */
+size_t text_utf8_decode(uint32_t *cp, const char *str, size_t len);
+/* get the display width of a codepoint, mirroring wcwidth(3): 0 for
+ * combining and other zero width characters, 1 or 2 for printable ones
+ * and -1 for non-printable ones */
+int text_unicode_width(uint32_t cp);
+/* get the length of the longest prefix of str consisting of printable
+ * ASCII characters (0x20-0x7E), each of which has a display width of 1 */
+size_t text_ascii_span(const char *str, size_t len);
+
+#endif
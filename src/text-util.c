@@ -1,7 +1,6 @@
 #include "text-util.h"
+#include "text-unicode.h"
 #include "util.h"
-#include <wchar.h>
-#include <errno.h>
 #include <stdlib.h>
 
 bool text_range_valid(const Filerange *r) {
@@ -58,28 +57,30 @@ bool text_range_contains(const Filerange *r, size_t pos) {
 
 int text_char_count(const char *data, size_t len) {
 	int count = 0;
-	mbstate_t ps = { 0 };
 	while (len > 0) {
-		wchar_t wc;
-		size_t wclen = mbrtowc(&wc, data, len, &ps);
-		if (wclen == (size_t)-1 && errno == EILSEQ) {
-			ps = (mbstate_t){0};
+		size_t ascii = text_ascii_span(data, len);
+		count += ascii;
+		data += ascii;
+		len -= ascii;
+		if (len == 0)
+			break;
+		uint32_t cp;
+		size_t clen = text_utf8_decode(&cp, data, len);
+		if (clen == (size_t)-1) {
 			count++;
-			while (!ISUTF8(*data))
-				data++, len--;
-		} else if (wclen == (size_t)-2) {
+			do data++, len--; while (len > 0 && !ISUTF8(*data));
+		} else if (clen == (size_t)-2) {
 			break;
-                } else if (wclen == 0) {
+		} else if (clen == 0) {
 			count++;
 			data++;
 			len--;
 		} else {
-			int width = wcwidth(wc);
-			if (width != 0)
+			if (text_unicode_width(cp) != 0)
 				count++;
-			data += wclen;
-			len -= wclen;
-                }
+			data += clen;
+			len -= clen;
+		}
 	}
 	return count;
 }
@@ -87,35 +88,39 @@ int text_char_count(const char *data, size_t len) {
 int text_string_width(const char *data, size_t len) {
 
 	int width = 0;
-	mbstate_t ps = { 0 };
 	const char *s = data;
 
 	while (len > 0) {
-		wchar_t wc;
-		size_t wclen = mbrtowc(&wc, s, len, &ps);
-		if (wclen == (size_t)-1 && errno == EILSEQ) {
-			ps = (mbstate_t){0};
+		size_t ascii = text_ascii_span(s, len);
+		width += ascii;
+		s += ascii;
+		len -= ascii;
+		if (len == 0)
+			break;
+		uint32_t cp;
+		size_t clen = text_utf8_decode(&cp, s, len);
+		if (clen == (size_t)-1) {
 			/* assume a replacement symbol will be displayed */
 			width++;
-			wclen = 1;
-		} else if (wclen == (size_t)-2) {
+			clen = 1;
+		} else if (clen == (size_t)-2) {
 			/* do nothing, advance to next character */
-			wclen = 1;
-		} else if (wclen == 0) {
+			clen = 1;
+		} else if (clen == 0) {
 			/* assume NUL byte will be displayed as ^@ */
 			width += 2;
-			wclen = 1;
-		} else if (wc == L'\t') {
+			clen = 1;
+		} else if (cp == '\t') {
 			width++;
-			wclen = 1;
+			clen = 1;
 		} else {
-			int w = wcwidth(wc);
+			int w = text_unicode_width(cp);
 			if (w == -1)
 				w = 2; /* assume non-printable will be displayed as ^{char} */
 			width += w;
 		}
-		len -= wclen;
-		s += wclen;
+		len -= clen;
+		s += clen;
 	}
 
 	return width;
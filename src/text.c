@@ -8,13 +8,14 @@
 #include <time.h>
 #include <fcntl.h>
 #include <errno.h>
-#include <wchar.h>
 #include <stdint.h>
 #include <libgen.h>
 #include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #if CONFIG_ACL
 #include <sys/acl.h>
 #endif
@@ -26,6 +27,9 @@
 #include "text-util.h"
 #include "text-motions.h"
 #include "util.h"
+#include "text-unicode.h"
+#include "text-profile.h"
+#include "lz4.h"
 
 /* Allocate blocks holding the actual file content in junks of size: */
 #ifndef BLOCK_SIZE
@@ -35,6 +39,27 @@
  * directely. Hence the former can be truncated, while doing so on the latter
  * results in havoc. */
 #define BLOCK_MMAP_SIZE (1 << 26)
+/* Insertion blocks of at least this size, or which would grow the heap
+ * allocated blocks of a text beyond BLOCK_SPILL_HEAP bytes, are backed
+ * by an unlinked temporary file instead. */
+#ifndef BLOCK_SPILL_SIZE
+#define BLOCK_SPILL_SIZE (1 << 26)
+#endif
+#ifndef BLOCK_SPILL_HEAP
+#define BLOCK_SPILL_HEAP ((size_t)1 << 30)
+#endif
+/* Every revision at a depth (distance from the root of the undo tree) which is
+ * a multiple of this value stores a checkpoint of its piece chain. Hence any
+ * revision can be restored by at most this many redo operations. */
+#ifndef REVISION_CHECKPOINT
+#define REVISION_CHECKPOINT 64
+#endif
+/* Heap allocated blocks which are not referenced by the current piece chain
+ * and have not been accessed during this many revisions are compressed, if
+ * enabled by text_compress_cold. */
+#ifndef BLOCK_COLD
+#define BLOCK_COLD 64
+#endif
 
 /* Block holding the file content, either readonly mmap(2)-ed from the original
  * file or heap allocated to store the modifications.
@@ -49,7 +74,12 @@ struct Block {
 		MMAP,              /* mmap(2)-ed from a temporary file only known to this process */
 		MALLOC,            /* heap allocated block using malloc(3) */
 	} type;
+	bool writable;             /* data may be modified in place */
 	Block *next;               /* next junk */
+	char *compressed;          /* compressed content, data is released while set */
+	size_t compressed_len;     /* size of the compressed content */
+	bool incompressible;       /* compression was attempted but not worthwhile */
+	size_t used;               /* revision epoch of most recent access */
 };
 
 /* A piece holds a reference (but doesn't itself store) a certain amount of data.
@@ -90,22 +120,35 @@ struct Change {
 	Span old;               /* all pieces which are being modified/swapped out by the change */
 	Span new;               /* all pieces which are introduced/swapped in by the change */
 	size_t pos;             /* absolute position at which the change occured */
+	Piece **removed;        /* pieces of the old span in order, if it consists of more than two */
+	size_t removed_count;   /* number of pieces stored in removed */
 	Change *next;           /* next change which is part of the same revision */
 	Change *prev;           /* previous change which is part of the same revision */
 };
 
+/* A Checkpoint materializes the piece chain of a revision such that the
+ * corresponding text state can be installed without replaying all changes
+ * leading up to it. */
+typedef struct {
+	Piece **pieces;         /* all pieces forming the document, in order */
+	size_t count;           /* number of pieces */
+	size_t size;            /* document size in bytes */
+} Checkpoint;
+
 /* A Revision is a list of Changes which are used to undo/redo all modifications
  * since the last snapshot operation. Revisions are stored in a directed graph structure.
  */
 typedef struct Revision Revision;
 struct Revision {
 	Change *change;         /* the most recent change */
+	Checkpoint *checkpoint; /* materialized piece chain, only every REVISION_CHECKPOINT levels */
 	Revision *next;         /* the next (child) revision in the undo tree */
 	Revision *prev;         /* the previous (parent) revision in the undo tree */
 	Revision *earlier;      /* the previous Revision, chronologically */
 	Revision *later;        /* the next Revision, chronologically */
 	time_t time;            /* when the first change of this revision was performed */
 	size_t seq;             /* a unique, strictly increasing identifier */
+	size_t depth;           /* distance from the root of the undo tree */
 };
 
 typedef struct {
@@ -113,6 +156,40 @@ typedef struct {
 	size_t lineno;          /* line number in file i.e. number of '\n' in [0, pos) */
 } LineCache;
 
+typedef struct {
+	TextLineInfo info;      /* metadata of the line, only meaningful if valid */
+	bool valid;             /* whether info has to be recomputed */
+} LineInfo;
+
+typedef struct {
+	LineInfo *lines;        /* per line metadata, indexed by line number - 1 */
+	size_t count;           /* number of lines in the text, unless stale */
+	size_t size;            /* allocated capacity of lines */
+	bool enabled;           /* whether the table is maintained at all */
+	bool stale;             /* whether the table has to be rebuilt from scratch */
+} LineTable;
+
+typedef struct {
+	size_t bol;             /* start of the line the checkpoints belong to */
+	TextColumn *columns[TEXT_COLUMN_TYPES]; /* checkpoints sorted by position */
+	size_t count[TEXT_COLUMN_TYPES];        /* number of checkpoints per type */
+	size_t size[TEXT_COLUMN_TYPES];         /* allocated capacity per type */
+} ColumnCache;
+
+typedef struct {
+	TextProfile profile;    /* statistics, only valid once done is set */
+	const char *data;       /* file content being profiled */
+	size_t len;             /* its length in bytes */
+	pthread_t thread;       /* background profiler of memory mapped files */
+	bool running;           /* whether the thread has yet to be joined */
+	atomic_bool done;       /* whether the profile is complete */
+} Profiler;
+
+typedef struct {
+	TextChanged changed;    /* called after every modification */
+	void *data;             /* passed along to it */
+} Listener;
+
 /* The main struct holding all information of a given file */
 struct Text {
 	Block *block;           /* original file content at the time of load operation */
@@ -124,9 +201,23 @@ struct Text {
 	Revision *current_revision; /* revision holding all file changes until a snapshot is performed */
 	Revision *last_revision;    /* the last revision added to the tree, chronologically */
 	Revision *saved_revision;   /* the last revision at the time of the save operation */
+	Revision **revisions;       /* all revisions in chronological order, indexed by seq */
+	size_t revisions_count;     /* number of revisions stored in the index */
+	size_t revisions_size;      /* allocated capacity of the index */
 	size_t size;            /* current file content size in bytes */
 	struct stat info;       /* stat as probed at load time */
 	LineCache lines;        /* mapping between absolute pos in bytes and logical line breaks */
+	LineTable line_table;   /* optional per line metadata, see text_line_info */
+	ColumnCache columns;    /* column checkpoints of a long line, see text_columns_get */
+	Profiler profiler;      /* statistics about the loaded file content */
+	size_t heap;            /* size of all heap allocated blocks in bytes */
+	size_t epoch;           /* number of revisions sealed by text_snapshot */
+	bool compress;          /* whether cold blocks should be compressed */
+	TextCompressStats compress_stats; /* information about compressed blocks */
+	Text *source;           /* text a view was created from */
+	atomic_size_t views;    /* number of views sharing the content */
+	Listener *listeners;    /* see text_listener_add */
+	size_t listeners_count;
 };
 
 struct TextSave {                  /* used to hold context between text_save_{begin,commit} calls */
@@ -147,6 +238,11 @@ static const char *block_append(Block*, const char *data, size_t len);
 static bool block_insert(Block*, size_t pos, const char *data, size_t len);
 static bool block_delete(Block*, size_t pos, size_t len);
 static const char *block_store(Text*, const char *data, size_t len);
+static bool text_insert_piece(Text*, Change*, Location, const char *data, size_t len);
+static bool block_compress(Text*, Block*);
+static bool block_decompress(Text*, Block*);
+static void blocks_compress(Text*);
+static bool blocks_access(Text*, const Piece *p);
 /* cache layer */
 static void cache_piece(Text *txt, Piece *p);
 static bool cache_contains(Text *txt, Piece *p);
@@ -161,16 +257,35 @@ static Location piece_get_extern(Text *txt, size_t pos);
 /* span management */
 static void span_init(Span *span, Piece *start, Piece *end);
 static void span_swap(Text *txt, Span *old, Span *new);
+static void span_relink(Text *txt, Change *c, Span *out, Span *in);
+static bool span_access(Text *txt, Change *c, Span *span);
 /* change management */
 static Change *change_alloc(Text *txt, size_t pos);
 static void change_free(Change *c);
 /* revision management */
 static Revision *revision_alloc(Text *txt);
 static void revision_free(Revision *rev);
+/* checkpoint management */
+static Checkpoint *checkpoint_alloc(Text *txt);
+static bool checkpoint_install(Text *txt, Checkpoint *cp);
+static void checkpoint_free(Checkpoint *cp);
 /* logical line counting cache */
 static void lineno_cache_invalidate(LineCache *cache);
 static size_t lines_skip_forward(Text *txt, size_t pos, size_t lines, size_t *lines_skiped);
+static size_t lines_skip_backward(Text *txt, size_t pos, size_t lines);
 static size_t lines_count(Text *txt, size_t pos, size_t len);
+/* per line metadata table */
+static size_t line_table_lineno(Text *txt, size_t pos);
+static void line_table_update(Text *txt, size_t lineno, size_t removed, size_t added);
+static void line_table_insert(Text *txt, size_t lineno, const char *data, size_t len);
+static void line_table_swap(Text *txt, Span *out, Span *in);
+/* column checkpoints of a long line */
+static void column_cache_invalidate(ColumnCache *cache);
+static void column_cache_update(Text *txt, size_t pos, size_t removed, size_t added);
+/* modification callbacks */
+static void listeners_notify(Text *txt, size_t pos, size_t removed, size_t added);
+/* load time content statistics */
+static bool profile_start(Text *txt);
 
 static ssize_t write_all(int fd, const char *buf, size_t count) {
 	size_t rem = count;
@@ -189,19 +304,40 @@ static ssize_t write_all(int fd, const char *buf, size_t count) {
 	return count - rem;
 }
 
-/* allocate a new block of MAX(size, BLOCK_SIZE) bytes */
+/* map a writable region of the given size backed by an unlinked temporary file */
+static char *block_spill(size_t size) {
+	char tmpname[32] = "/tmp/vis-XXXXXX";
+	int fd = mkstemp(tmpname);
+	if (fd == -1)
+		return NULL;
+	char *data = MAP_FAILED;
+	if (unlink(tmpname) == 0 && ftruncate(fd, size) == 0)
+		data = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	return data == MAP_FAILED ? NULL : data;
+}
+
+/* allocate a new block of MAX(size, BLOCK_SIZE) bytes, large ones are
+ * spilled to disk, falling back to the heap if that fails */
 static Block *block_alloc(Text *txt, size_t size) {
 	Block *blk = calloc(1, sizeof *blk);
 	if (!blk)
 		return NULL;
 	if (BLOCK_SIZE > size)
 		size = BLOCK_SIZE;
-	if (!(blk->data = malloc(size))) {
+	if ((size >= BLOCK_SPILL_SIZE || txt->heap + size > BLOCK_SPILL_HEAP) &&
+	    (blk->data = block_spill(size))) {
+		blk->type = MMAP;
+	} else if ((blk->data = malloc(size))) {
+		blk->type = MALLOC;
+		txt->heap += size;
+	} else {
 		free(blk);
 		return NULL;
 	}
-	blk->type = MALLOC;
 	blk->size = size;
+	blk->writable = true;
+	blk->used = txt->epoch;
 	blk->next = txt->blocks;
 	txt->blocks = blk;
 	return blk;
@@ -233,11 +369,14 @@ static Block *block_mmap(Text *txt, size_t size, int fd, off_t offset) {
 	if (!blk)
 		return NULL;
 	if (size) {
-		blk->data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, offset);
-		if (blk->data == MAP_FAILED) {
+		/* mmap(2) requires a page aligned offset */
+		off_t delta = offset % sysconf(_SC_PAGESIZE);
+		char *data = mmap(NULL, size + delta, PROT_READ, MAP_SHARED, fd, offset - delta);
+		if (data == MAP_FAILED) {
 			free(blk);
 			return NULL;
 		}
+		blk->data = data + delta;
 	}
 	blk->type = MMAP_ORIG;
 	blk->size = size;
@@ -250,10 +389,13 @@ static Block *block_mmap(Text *txt, size_t size, int fd, off_t offset) {
 static void block_free(Block *blk) {
 	if (!blk)
 		return;
+	free(blk->compressed);
 	if (blk->type == MALLOC)
 		free(blk->data);
-	else if ((blk->type == MMAP_ORIG || blk->type == MMAP) && blk->data)
-		munmap(blk->data, blk->size);
+	else if ((blk->type == MMAP_ORIG || blk->type == MMAP) && blk->data) {
+		size_t delta = (uintptr_t)blk->data % sysconf(_SC_PAGESIZE);
+		munmap(blk->data - delta, blk->size + delta);
+	}
 	free(blk);
 }
 
@@ -278,6 +420,119 @@ static const char *block_store(Text *txt, const char *data, size_t len) {
 	return block_append(blk, data, len);
 }
 
+/* is the block a candidate for compression? the most recent one is still
+ * used to append new insertions and is therefore never considered */
+static bool block_cold(Text *txt, Block *blk) {
+	return blk != txt->blocks && blk->type == MALLOC && blk->len &&
+	       !blk->compressed && !blk->incompressible &&
+	       txt->epoch - blk->used >= BLOCK_COLD;
+}
+
+/* compress the block content and return the memory pages backing it to
+ * the operating system. the address range itself remains allocated such
+ * that all pointers into the block stay valid once it is decompressed. */
+static bool block_compress(Text *txt, Block *blk) {
+	char *compressed = malloc(lz4_compress_bound(blk->len));
+	if (!compressed)
+		return false;
+	size_t len = lz4_compress(blk->data, blk->len, compressed);
+	if (!len || len > blk->len - blk->len / 4) {
+		free(compressed);
+		blk->incompressible = true;
+		return false;
+	}
+	char *shrunk = realloc(compressed, len);
+	if (shrunk)
+		compressed = shrunk;
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+	uintptr_t start = ((uintptr_t)blk->data + pagesize - 1) & ~(pagesize - 1);
+	uintptr_t end = ((uintptr_t)blk->data + blk->size) & ~(pagesize - 1);
+	if (start < end)
+		madvise((void*)start, end - start, MADV_DONTNEED);
+	blk->compressed = compressed;
+	blk->compressed_len = len;
+	txt->compress_stats.blocks++;
+	txt->compress_stats.size += blk->len;
+	txt->compress_stats.compressed += len;
+	return true;
+}
+
+/* restore the block content at its original address */
+static bool block_decompress(Text *txt, Block *blk) {
+	if (!lz4_decompress(blk->compressed, blk->compressed_len, blk->data, blk->len))
+		return false;
+	txt->compress_stats.blocks--;
+	txt->compress_stats.size -= blk->len;
+	txt->compress_stats.compressed -= blk->compressed_len;
+	txt->compress_stats.decompressed++;
+	free(blk->compressed);
+	blk->compressed = NULL;
+	blk->compressed_len = 0;
+	return true;
+}
+
+static int block_cmp(const void *a, const void *b) {
+	const Block *b1 = *(const Block**)a, *b2 = *(const Block**)b;
+	return b1->data < b2->data ? -1 : b1->data > b2->data;
+}
+
+/* compress all cold blocks which are not referenced by the current piece chain */
+static void blocks_compress(Text *txt) {
+	size_t count = 0;
+	for (Block *blk = txt->blocks; blk; blk = blk->next) {
+		if (block_cold(txt, blk))
+			count++;
+	}
+	if (!count)
+		return;
+	Block **cold = malloc(count * sizeof *cold);
+	if (!cold)
+		return;
+	count = 0;
+	for (Block *blk = txt->blocks; blk; blk = blk->next) {
+		if (block_cold(txt, blk))
+			cold[count++] = blk;
+	}
+	qsort(cold, count, sizeof *cold, block_cmp);
+	for (Piece *p = txt->begin.next; p->next; p = p->next) {
+		size_t lo = 0, hi = count;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (p->data < cold[mid]->data)
+				hi = mid;
+			else if (p->data >= cold[mid]->data + cold[mid]->size)
+				lo = mid + 1;
+			else {
+				cold[mid]->used = txt->epoch;
+				break;
+			}
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (cold[i]->used != txt->epoch)
+			block_compress(txt, cold[i]);
+	}
+	free(cold);
+}
+
+/* mark the block holding the data of the given piece as used, decompress it
+ * if necessary. has to be called before a piece becomes part of the chain.
+ * returns false if the data could not be restored, the block then remains
+ * compressed and the piece must not be linked in */
+static bool blocks_access(Text *txt, const Piece *p) {
+	if (!txt->compress_stats.blocks)
+		return true;
+	for (Block *blk = txt->blocks; blk; blk = blk->next) {
+		if (blk->data <= p->data && p->data < blk->data + blk->size) {
+			if (blk->compressed && !block_decompress(txt, blk))
+				return false;
+			blk->used = txt->epoch;
+			return true;
+		}
+	}
+	return true;
+}
+
 /* insert data into block at an arbitrary position, this should only be used with
  * data of the most recently created piece. */
 static bool block_insert(Block *blk, size_t pos, const char *data, size_t len) {
@@ -322,6 +577,12 @@ static bool cache_contains(Text *txt, Piece *p) {
 	Revision *rev = txt->current_revision;
 	if (!blk || !txt->cache || txt->cache != p || !rev || !rev->change)
 		return false;
+	/* file mappings inserted by text_insert_file are read only */
+	if (!blk->writable)
+		return false;
+	/* views might refer to the piece content which would be modified */
+	if (atomic_load(&txt->views))
+		return false;
 
 	Piece *start = rev->change->new.start;
 	Piece *end = rev->change->new.end;
@@ -410,13 +671,99 @@ static void span_swap(Text *txt, Span *old, Span *new) {
 	txt->size += new->len;
 }
 
+/* restore the links of the pieces forming span in, which is about to replace
+ * span out by means of an undo/redo operation of change c.
+ *
+ * pieces which are not part of the chain keep whatever pointers they had when
+ * they were last swapped out. after a checkpoint was installed these might no
+ * longer reflect the neighbours they are supposed to be swapped in between,
+ * hence they are recomputed from information which is known to be valid:
+ *
+ *  - the neighbours are taken from the span being swapped out or, if it is
+ *    empty, looked up by the position at which the change occured
+ *  - the pieces of a new span are allocated in chain order and can thus be
+ *    recovered from the global allocation list (pieces are never freed
+ *    before the text itself)
+ *  - old spans of up to two pieces are fully described by their start and
+ *    end, longer ones are recorded at creation time in c->removed
+ */
+static void span_relink(Text *txt, Change *c, Span *out, Span *in) {
+	if (in->len == 0)
+		return;
+	Piece *prev, *next;
+	if (out->len == 0) {
+		Location loc = piece_get_intern(txt, c->pos);
+		if (!loc.piece)
+			return;
+		prev = loc.piece;
+		next = prev->next;
+	} else {
+		prev = out->start->prev;
+		next = out->end->next;
+	}
+
+	if (in == &c->new) {
+		for (Piece *p = in->start; p != in->end; p = p->global_prev) {
+			p->prev = prev;
+			p->next = p->global_prev;
+			prev = p;
+		}
+	} else if (c->removed) {
+		for (size_t i = 0; i + 1 < c->removed_count; i++) {
+			Piece *p = c->removed[i];
+			p->prev = prev;
+			p->next = c->removed[i+1];
+			prev = p;
+		}
+	} else if (in->start != in->end) {
+		in->start->prev = prev;
+		in->start->next = in->end;
+		prev = in->start;
+	}
+
+	in->end->prev = prev;
+	in->end->next = next;
+}
+
+/* make sure the data of all pieces of a span of change c is accessible.
+ * its pieces are enumerated as by span_relink, since their links might be
+ * outdated until the span is swapped in */
+static bool span_access(Text *txt, Change *c, Span *span) {
+	if (!txt->compress_stats.blocks || span->len == 0)
+		return true;
+	if (span == &c->new) {
+		for (Piece *p = span->start; p != span->end; p = p->global_prev) {
+			if (!blocks_access(txt, p))
+				return false;
+		}
+	} else if (c->removed) {
+		for (size_t i = 0; i + 1 < c->removed_count; i++) {
+			if (!blocks_access(txt, c->removed[i]))
+				return false;
+		}
+	} else if (span->start != span->end && !blocks_access(txt, span->start)) {
+		return false;
+	}
+	return blocks_access(txt, span->end);
+}
+
 /* Allocate a new revision and place it in the revision graph.
  * All further changes will be associated with this revision. */
 static Revision *revision_alloc(Text *txt) {
+	if (txt->revisions_count == txt->revisions_size) {
+		size_t size = txt->revisions_size ? 2 * txt->revisions_size : 64;
+		Revision **revisions = realloc(txt->revisions, size * sizeof *revisions);
+		if (!revisions)
+			return NULL;
+		txt->revisions = revisions;
+		txt->revisions_size = size;
+	}
 	Revision *rev = calloc(1, sizeof *rev);
 	if (!rev)
 		return NULL;
+	txt->revisions[txt->revisions_count++] = rev;
 	rev->time = time(NULL);
+	rev->depth = txt->history ? txt->history->depth + 1 : 0;
 	txt->current_revision = rev;
 
 	/* set sequence number */
@@ -449,9 +796,57 @@ static void revision_free(Revision *rev) {
 		next = c->next;
 		change_free(c);
 	}
+	checkpoint_free(rev->checkpoint);
 	free(rev);
 }
 
+/* materialize the current piece chain */
+static Checkpoint *checkpoint_alloc(Text *txt) {
+	Checkpoint *cp = calloc(1, sizeof *cp);
+	if (!cp)
+		return NULL;
+	for (Piece *p = txt->begin.next; p->next; p = p->next)
+		cp->count++;
+	if (!(cp->pieces = malloc(cp->count * sizeof(Piece*)))) {
+		free(cp);
+		return NULL;
+	}
+	size_t i = 0;
+	for (Piece *p = txt->begin.next; p->next; p = p->next)
+		cp->pieces[i++] = p;
+	cp->size = txt->size;
+	return cp;
+}
+
+/* replace the current piece chain with the one stored in the checkpoint,
+ * fails without modifying the chain if some data can not be restored */
+static bool checkpoint_install(Text *txt, Checkpoint *cp) {
+	for (size_t i = 0; i < cp->count; i++) {
+		if (!blocks_access(txt, cp->pieces[i]))
+			return false;
+	}
+	Piece *prev = &txt->begin;
+	for (size_t i = 0; i < cp->count; i++) {
+		Piece *p = cp->pieces[i];
+		prev->next = p;
+		p->prev = prev;
+		prev = p;
+	}
+	prev->next = &txt->end;
+	txt->end.prev = prev;
+	txt->size = cp->size;
+	txt->line_table.stale = true;
+	column_cache_invalidate(&txt->columns);
+	return true;
+}
+
+static void checkpoint_free(Checkpoint *cp) {
+	if (!cp)
+		return;
+	free(cp->pieces);
+	free(cp);
+}
+
 static Piece *piece_alloc(Text *txt) {
 	Piece *p = calloc(1, sizeof *p);
 	if (!p)
@@ -552,6 +947,7 @@ static void change_free(Change *c) {
 	if (c->new.start != c->new.end)
 		piece_free(c->new.end);
 	piece_free(c->new.start);
+	free(c->removed);
 	free(c);
 }
 
@@ -589,14 +985,19 @@ bool text_insert(Text *txt, size_t pos, const char *data, size_t len) {
 		return false;
 	if (pos < txt->lines.pos)
 		lineno_cache_invalidate(&txt->lines);
+	size_t lineno = line_table_lineno(txt, pos);
 
 	Location loc = piece_get_intern(txt, pos);
 	Piece *p = loc.piece;
 	if (!p)
 		return false;
 	size_t off = loc.off;
-	if (cache_insert(txt, p, off, data, len))
+	if (cache_insert(txt, p, off, data, len)) {
+		line_table_insert(txt, lineno, data, len);
+		column_cache_update(txt, pos, 0, len);
+		listeners_notify(txt, pos, 0, len);
 		return true;
+	}
 
 	Change *c = change_alloc(txt, pos);
 	if (!c)
@@ -605,6 +1006,19 @@ bool text_insert(Text *txt, size_t pos, const char *data, size_t len) {
 	if (!(data = block_store(txt, data, len)))
 		return false;
 
+	if (!text_insert_piece(txt, c, loc, data, len))
+		return false;
+	line_table_insert(txt, lineno, data, len);
+	column_cache_update(txt, pos, 0, len);
+	listeners_notify(txt, pos, 0, len);
+	return true;
+}
+
+/* splice a new piece referencing data, which is already stored in a block,
+ * into the chain at the given location */
+static bool text_insert_piece(Text *txt, Change *c, Location loc, const char *data, size_t len) {
+	Piece *p = loc.piece;
+	size_t off = loc.off;
 	Piece *new = NULL;
 
 	if (off == p->len) {
@@ -639,6 +1053,44 @@ bool text_insert(Text *txt, size_t pos, const char *data, size_t len) {
 	return true;
 }
 
+bool text_insert_file(Text *txt, size_t pos, int fd, off_t off, size_t len) {
+	if (len == 0)
+		return true;
+	struct stat info;
+	size_t end;
+	if (pos > txt->size || off < 0 || fstat(fd, &info) == -1)
+		return false;
+	if (!S_ISREG(info.st_mode) || !addu((size_t)off, len, &end) || end > (size_t)info.st_size) {
+		errno = EINVAL;
+		return false;
+	}
+	if (pos < txt->lines.pos)
+		lineno_cache_invalidate(&txt->lines);
+	size_t lineno = line_table_lineno(txt, pos);
+
+	Location loc = piece_get_intern(txt, pos);
+	if (!loc.piece)
+		return false;
+	Block *blk = block_mmap(txt, len, fd, off);
+	if (!blk)
+		return false;
+	if (blk->next) {
+		/* keep the most recent insertion block in front, see block_store */
+		txt->blocks = blk->next;
+		blk->next = txt->blocks->next;
+		txt->blocks->next = blk;
+	}
+	Change *c = change_alloc(txt, pos);
+	if (!c)
+		return false;
+	if (!text_insert_piece(txt, c, loc, blk->data, len))
+		return false;
+	line_table_insert(txt, lineno, blk->data, len);
+	column_cache_update(txt, pos, 0, len);
+	listeners_notify(txt, pos, 0, len);
+	return true;
+}
+
 static bool text_vprintf(Text *txt, size_t pos, const char *format, va_list ap) {
 	va_list ap_save;
 	va_copy(ap_save, ap);
@@ -670,10 +1122,27 @@ bool text_printf(Text *txt, size_t pos, const char *format, ...) {
 	return ret;
 }
 
+/* make sure the data of all pieces linked in by undoing or redoing the
+ * revision is accessible before any of its changes is applied */
+static bool revision_access(Text *txt, Revision *rev, bool undo) {
+	for (Change *c = rev->change; c; c = c->next) {
+		if (!span_access(txt, c, undo ? &c->old : &c->new))
+			return false;
+	}
+	return true;
+}
+
 static size_t revision_undo(Text *txt, Revision *rev) {
 	size_t pos = EPOS;
 	for (Change *c = rev->change; c; c = c->next) {
+		span_relink(txt, c, &c->new, &c->old);
+		line_table_swap(txt, &c->new, &c->old);
 		span_swap(txt, &c->new, &c->old);
+		column_cache_invalidate(&txt->columns);
+		if (c->new.len > c->old.len)
+			listeners_notify(txt, c->pos, c->new.len - c->old.len, 0);
+		else
+			listeners_notify(txt, c->pos, 0, c->old.len - c->new.len);
 		pos = c->pos;
 	}
 	return pos;
@@ -685,7 +1154,14 @@ static size_t revision_redo(Text *txt, Revision *rev) {
 	while (c->next)
 		c = c->next;
 	for ( ; c; c = c->prev) {
+		span_relink(txt, c, &c->old, &c->new);
+		line_table_swap(txt, &c->old, &c->new);
 		span_swap(txt, &c->old, &c->new);
+		column_cache_invalidate(&txt->columns);
+		if (c->old.len > c->new.len)
+			listeners_notify(txt, c->pos, c->old.len - c->new.len, 0);
+		else
+			listeners_notify(txt, c->pos, 0, c->new.len - c->old.len);
 		pos = c->pos;
 		if (c->new.len > c->old.len)
 			pos += c->new.len - c->old.len;
@@ -698,7 +1174,7 @@ size_t text_undo(Text *txt) {
 	/* taking rev snapshot makes sure that txt->current_revision is reset */
 	text_snapshot(txt);
 	Revision *rev = txt->history->prev;
-	if (!rev)
+	if (!rev || !revision_access(txt, txt->history, true))
 		return pos;
 	pos = revision_undo(txt, txt->history);
 	txt->history = rev;
@@ -711,7 +1187,7 @@ size_t text_redo(Text *txt) {
 	/* taking a snapshot makes sure that txt->current_revision is reset */
 	text_snapshot(txt);
 	Revision *rev = txt->history->next;
-	if (!rev)
+	if (!rev || !revision_access(txt, rev, false))
 		return pos;
 	pos = revision_redo(txt, rev);
 	txt->history = rev;
@@ -731,29 +1207,91 @@ static bool history_change_branch(Revision *rev) {
 	return changed;
 }
 
+/* number of undo/redo operations needed to get from revision a to b,
+ * but at most limit + 1 */
+static size_t history_distance(Revision *a, Revision *b, size_t limit) {
+	size_t dist = 0;
+	while (a != b && dist <= limit) {
+		if (a->depth >= b->depth)
+			a = a->prev;
+		else
+			b = b->prev;
+		dist++;
+	}
+	return dist;
+}
+
+/* install the checkpoint of the closest ancestor and replay the remaining
+ * revisions, assumes history_change_branch(rev) was called */
+static size_t history_checkpoint_to(Text *txt, Revision *rev) {
+	Revision *base = rev;
+	while (base && !base->checkpoint)
+		base = base->prev;
+	if (!base)
+		return EPOS;
+	text_snapshot(txt);
+	size_t size = txt->size;
+	if (!checkpoint_install(txt, base->checkpoint))
+		return EPOS;
+	/* the whole content was replaced at once */
+	listeners_notify(txt, 0, size, txt->size);
+	txt->history = base;
+	size_t pos = EPOS;
+	Change *c = base->change;
+	if (c) {
+		pos = c->pos;
+		if (c->new.len > c->old.len)
+			pos += c->new.len - c->old.len;
+	}
+	while (txt->history != rev) {
+		Revision *next = txt->history->next;
+		if (!revision_access(txt, next, false))
+			break;
+		pos = revision_redo(txt, next);
+		txt->history = next;
+	}
+	lineno_cache_invalidate(&txt->lines);
+	return pos;
+}
+
 static size_t history_traverse_to(Text *txt, Revision *rev) {
 	size_t pos = EPOS;
 	if (!rev)
 		return pos;
 	bool changed = history_change_branch(rev);
+	text_snapshot(txt);
+	if (history_distance(txt->history, rev, REVISION_CHECKPOINT) > REVISION_CHECKPOINT) {
+		pos = history_checkpoint_to(txt, rev);
+		if (txt->history == rev)
+			return pos;
+	}
 	if (!changed) {
 		if (rev->seq == txt->history->seq) {
 			return txt->lines.pos;
 		} else if (rev->seq > txt->history->seq) {
-			while (txt->history != rev)
-				pos = text_redo(txt);
+			while (txt->history != rev) {
+				if ((pos = text_redo(txt)) == EPOS)
+					break;
+			}
 			return pos;
 		} else if (rev->seq < txt->history->seq) {
-			while (txt->history != rev)
-				pos = text_undo(txt);
+			while (txt->history != rev) {
+				if ((pos = text_undo(txt)) == EPOS)
+					break;
+			}
 			return pos;
 		}
 	} else {
-		while (txt->history->prev && txt->history->prev->next == txt->history)
-			text_undo(txt);
+		/* undo and redo fail if the data of a revision can not be restored */
+		while (txt->history->prev && txt->history->prev->next == txt->history) {
+			if (text_undo(txt) == EPOS)
+				return EPOS;
+		}
 		pos = text_undo(txt);
-		while (txt->history != rev)
-			pos = text_redo(txt);
+		while (txt->history != rev) {
+			if ((pos = text_redo(txt)) == EPOS)
+				break;
+		}
 		return pos;
 	}
 	return pos;
@@ -768,11 +1306,17 @@ size_t text_later(Text *txt) {
 }
 
 size_t text_restore(Text *txt, time_t time) {
-	Revision *rev = txt->history;
-	while (time < rev->time && rev->earlier)
-		rev = rev->earlier;
-	while (time > rev->time && rev->later)
-		rev = rev->later;
+	/* sequence numbers and creation times are both monotonic, binary
+	 * search the first revision which is not older than time */
+	size_t lo = 0, hi = txt->revisions_count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (txt->revisions[mid]->time < time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	Revision *rev = txt->revisions[MIN(lo, txt->revisions_count - 1)];
 	time_t diff = labs(rev->time - time);
 	if (rev->earlier && rev->earlier != txt->history && labs(rev->earlier->time - time) < diff)
 		rev = rev->earlier;
@@ -949,6 +1493,7 @@ static bool text_save_begin_inplace(TextSave *ctx) {
 		 * file and remap it at the same position such that all pointers
 		 * from the various pieces are still valid.
 		 */
+		text_profile(txt, true);
 		size_t size = txt->block->size;
 		char tmpname[32] = "/tmp/vis-XXXXXX";
 		newfd = mkstemp(tmpname);
@@ -959,16 +1504,10 @@ static bool text_save_begin_inplace(TextSave *ctx) {
 		ssize_t written = write_all(newfd, txt->block->data, size);
 		if (written == -1 || (size_t)written != size)
 			goto err;
-		if (munmap(txt->block->data, size) == -1)
-			goto err;
-
-		void *data = mmap(txt->block->data, size, PROT_READ, MAP_SHARED, newfd, 0);
+		/* replace the mapping in one step, views might be reading it */
+		void *data = mmap(txt->block->data, size, PROT_READ, MAP_SHARED|MAP_FIXED, newfd, 0);
 		if (data == MAP_FAILED)
 			goto err;
-		if (data != txt->block->data) {
-			munmap(data, size);
-			goto err;
-		}
 		bool close_failed = (close(newfd) == -1);
 		newfd = -1;
 		if (close_failed)
@@ -1158,6 +1697,8 @@ Text *text_load_method(const char *filename, enum TextLoadMethod method) {
 
 	if (size == 0)
 		piece_init(p, &txt->begin, &txt->end, "\0", 0);
+	if (!profile_start(txt))
+		goto out;
 
 	piece_init(&txt->begin, NULL, p, NULL, 0);
 	piece_init(&txt->end, p, NULL, NULL, 0);
@@ -1203,14 +1744,20 @@ bool text_delete(Text *txt, size_t pos, size_t len) {
 		return false;
 	if (pos < txt->lines.pos)
 		lineno_cache_invalidate(&txt->lines);
+	size_t lineno = line_table_lineno(txt, pos);
+	size_t lines = lineno ? lines_count(txt, pos, len) : 0;
 
 	Location loc = piece_get_intern(txt, pos);
 	Piece *p = loc.piece;
 	if (!p)
 		return false;
 	size_t off = loc.off;
-	if (cache_delete(txt, p, off, len))
+	if (cache_delete(txt, p, off, len)) {
+		line_table_update(txt, lineno, lines, 0);
+		column_cache_update(txt, pos, len, 0);
+		listeners_notify(txt, pos, len, 0);
 		return true;
+	}
 	Change *c = change_alloc(txt, pos);
 	if (!c)
 		return false;
@@ -1260,6 +1807,21 @@ bool text_delete(Text *txt, size_t pos, size_t len) {
 		piece_init(before, start->prev, after, start->data, off);
 	}
 
+	/* remember the order of the removed pieces, see span_relink */
+	size_t removed_count = 1;
+	for (Piece *cur = start; cur != end; cur = cur->next)
+		removed_count++;
+	if (removed_count > 2) {
+		if (!(c->removed = malloc(removed_count * sizeof(Piece*))))
+			return false;
+		c->removed_count = 0;
+		for (Piece *cur = start; ; cur = cur->next) {
+			c->removed[c->removed_count++] = cur;
+			if (cur == end)
+				break;
+		}
+	}
+
 	Piece *new_start = NULL, *new_end = NULL;
 	if (midway_start) {
 		new_start = before;
@@ -1275,6 +1837,9 @@ bool text_delete(Text *txt, size_t pos, size_t len) {
 	span_init(&c->new, new_start, new_end);
 	span_init(&c->old, start, end);
 	span_swap(txt, &c->old, &c->new);
+	line_table_update(txt, lineno, lines, 0);
+	column_cache_update(txt, pos, len, 0);
+	listeners_notify(txt, pos, len, 0);
 	return true;
 }
 
@@ -1287,8 +1852,14 @@ bool text_delete_range(Text *txt, Filerange *r) {
 /* preserve the current text content such that it can be restored by
  * means of undo/redo operations */
 void text_snapshot(Text *txt) {
-	if (txt->current_revision)
-		txt->last_revision = txt->current_revision;
+	Revision *rev = txt->current_revision;
+	if (rev) {
+		txt->last_revision = rev;
+		if (rev->depth % REVISION_CHECKPOINT == 0 && !rev->checkpoint)
+			rev->checkpoint = checkpoint_alloc(txt);
+		if (++txt->epoch % BLOCK_COLD == 0 && txt->compress && !atomic_load(&txt->views))
+			blocks_compress(txt);
+	}
 	txt->current_revision = NULL;
 	txt->cache = NULL;
 }
@@ -1298,6 +1869,9 @@ void text_free(Text *txt) {
 	if (!txt)
 		return;
 
+	text_profile(txt, true);
+	free(txt->profiler.profile.ascii);
+
 	// free history
 	Revision *hist = txt->history;
 	while (hist && hist->prev)
@@ -1307,6 +1881,11 @@ void text_free(Text *txt) {
 		revision_free(hist);
 		hist = later;
 	}
+	free(txt->revisions);
+	free(txt->listeners);
+	free(txt->line_table.lines);
+	for (int i = 0; i < TEXT_COLUMN_TYPES; i++)
+		free(txt->columns.columns[i]);
 
 	for (Piece *next, *p = txt->pieces; p; p = next) {
 		next = p->global_next;
@@ -1318,13 +1897,73 @@ void text_free(Text *txt) {
 		block_free(blk);
 	}
 
+	if (txt->source)
+		atomic_fetch_sub(&txt->source->views, 1);
 	free(txt);
 }
 
+Text *text_view(Text *txt) {
+	Text *view = calloc(1, sizeof *view);
+	if (!view)
+		return NULL;
+	lineno_cache_invalidate(&view->lines);
+	/* the view owns copies of the pieces but none of the blocks */
+	Piece *prev = &view->begin;
+	for (Piece *p = txt->begin.next; p && p->next; p = p->next) {
+		Piece *copy = piece_alloc(view);
+		if (!copy) {
+			text_free(view);
+			return NULL;
+		}
+		piece_init(copy, prev, NULL, p->data, p->len);
+		prev->next = copy;
+		prev = copy;
+	}
+	prev->next = &view->end;
+	view->end.prev = prev;
+	view->size = txt->size;
+	view->info = txt->info;
+	view->source = txt;
+	atomic_fetch_add(&txt->views, 1);
+	return view;
+}
+
+bool text_listener_add(Text *txt, TextChanged changed, void *data) {
+	Listener *listeners = realloc(txt->listeners, (txt->listeners_count + 1) * sizeof *listeners);
+	if (!listeners)
+		return false;
+	listeners[txt->listeners_count++] = (Listener){ .changed = changed, .data = data };
+	txt->listeners = listeners;
+	return true;
+}
+
+void text_listener_remove(Text *txt, TextChanged changed, void *data) {
+	for (size_t i = 0; i < txt->listeners_count; i++) {
+		if (txt->listeners[i].changed == changed && txt->listeners[i].data == data) {
+			memmove(&txt->listeners[i], &txt->listeners[i+1], (txt->listeners_count - i - 1) * sizeof *txt->listeners);
+			txt->listeners_count--;
+			return;
+		}
+	}
+}
+
+static void listeners_notify(Text *txt, size_t pos, size_t removed, size_t added) {
+	for (size_t i = 0; i < txt->listeners_count; i++)
+		txt->listeners[i].changed(txt->listeners[i].data, pos, removed, added);
+}
+
 bool text_modified(Text *txt) {
 	return txt->saved_revision != txt->history;
 }
 
+void text_compress_cold(Text *txt, bool enable) {
+	txt->compress = enable;
+}
+
+TextCompressStats text_compress_stats(Text *txt) {
+	return txt->compress_stats;
+}
+
 bool text_mmaped(Text *txt, const char *ptr) {
 	uintptr_t addr = (uintptr_t)ptr;
 	for (Block *blk = txt->blocks; blk; blk = blk->next) {
@@ -1482,23 +2121,42 @@ bool text_iterator_codepoint_prev(Iterator *it, char *c) {
 	return false;
 }
 
+/* get up to UTF8_LEN_MAX bytes starting at the iterator position. they are
+ * read directly from the current piece, only a sequence which might straddle
+ * a piece boundary is stitched together in buf */
+static size_t text_iterator_peek(const Iterator *it, char buf[UTF8_LEN_MAX], const char **s) {
+	size_t len = it->end - it->text;
+	if (len >= UTF8_LEN_MAX) {
+		*s = it->text;
+		return UTF8_LEN_MAX;
+	}
+	memcpy(buf, it->text, len);
+	for (const Piece *p = it->piece->next; len < UTF8_LEN_MAX && p && p->text; p = p->next) {
+		size_t n = MIN(p->len, UTF8_LEN_MAX - len);
+		memcpy(buf + len, p->data, n);
+		len += n;
+	}
+	*s = buf;
+	return len;
+}
+
 bool text_iterator_char_next(Iterator *it, char *c) {
 	if (!text_iterator_codepoint_next(it, c))
 		return false;
-	mbstate_t ps = { 0 };
 	for (;;) {
-		char buf[MB_LEN_MAX];
-		size_t len = text_bytes_get(it->piece->text, it->pos, sizeof buf, buf);
-		wchar_t wc;
-		size_t wclen = mbrtowc(&wc, buf, len, &ps);
-		if (wclen == (size_t)-1 && errno == EILSEQ) {
+		char buf[UTF8_LEN_MAX];
+		const char *s;
+		size_t len = text_iterator_peek(it, buf, &s);
+		uint32_t cp;
+		size_t clen = text_utf8_decode(&cp, s, len);
+		if (clen == (size_t)-1) {
 			return true;
-		} else if (wclen == (size_t)-2) {
+		} else if (clen == (size_t)-2) {
 			return false;
-		} else if (wclen == 0) {
+		} else if (clen == 0) {
 			return true;
 		} else {
-			int width = wcwidth(wc);
+			int width = text_unicode_width(cp);
 			if (width != 0)
 				return true;
 			if (!text_iterator_codepoint_next(it, c))
@@ -1512,19 +2170,19 @@ bool text_iterator_char_prev(Iterator *it, char *c) {
 	if (!text_iterator_codepoint_prev(it, c))
 		return false;
 	for (;;) {
-		char buf[MB_LEN_MAX];
-		size_t len = text_bytes_get(it->piece->text, it->pos, sizeof buf, buf);
-		wchar_t wc;
-		mbstate_t ps = { 0 };
-		size_t wclen = mbrtowc(&wc, buf, len, &ps);
-		if (wclen == (size_t)-1 && errno == EILSEQ) {
+		char buf[UTF8_LEN_MAX];
+		const char *s;
+		size_t len = text_iterator_peek(it, buf, &s);
+		uint32_t cp;
+		size_t clen = text_utf8_decode(&cp, s, len);
+		if (clen == (size_t)-1) {
 			return true;
-		} else if (wclen == (size_t)-2) {
+		} else if (clen == (size_t)-2) {
 			return false;
-		} else if (wclen == 0) {
+		} else if (clen == 0) {
 			return true;
 		} else {
-			int width = wcwidth(wc);
+			int width = text_unicode_width(cp);
 			if (width != 0)
 				return true;
 			if (!text_iterator_codepoint_prev(it, c))
@@ -1534,6 +2192,42 @@ bool text_iterator_char_prev(Iterator *it, char *c) {
 	return true;
 }
 
+size_t text_iterator_ascii_next(Iterator *it, size_t max) {
+	if (!text_iterator_valid(it) || it->text >= it->end)
+		return 0;
+	/* moving from one printable ASCII character to the next one never
+	 * crosses a zero width codepoint, the last one of the run is left
+	 * to text_iterator_char_next which has to inspect its successor */
+	size_t avail = it->end - it->text;
+	if (max < avail)
+		avail = max + 1;
+	size_t len = text_ascii_span(it->text, avail);
+	size_t n = len ? len - 1 : 0;
+	it->text += n;
+	it->pos += n;
+	return n;
+}
+
+size_t text_iterator_run_next(Iterator *it, size_t (*run)(const char *s, size_t len, void *data), void *data) {
+	if (!text_iterator_valid(it) || it->text >= it->end)
+		return 0;
+	size_t len = run(it->text, it->end - it->text, data);
+	size_t n = len ? len - 1 : 0;
+	it->text += n;
+	it->pos += n;
+	return n;
+}
+
+size_t text_iterator_run_prev(Iterator *it, size_t (*run)(const char *s, size_t len, void *data), void *data) {
+	if (!text_iterator_valid(it) || it->text >= it->end)
+		return 0;
+	size_t len = run(it->start, it->text + 1 - it->start, data);
+	size_t n = len ? len - 1 : 0;
+	it->text -= n;
+	it->pos -= n;
+	return n;
+}
+
 bool text_byte_get(Text *txt, size_t pos, char *byte) {
 	return text_bytes_get(txt, pos, 1, byte);
 }
@@ -1560,6 +2254,35 @@ size_t text_bytes_get(Text *txt, size_t pos, size_t len, char *buf) {
 	return len - rem;
 }
 
+size_t text_strings_get(Text *txt, size_t pos, size_t len, TextString *strs, size_t count) {
+	size_t n = 0;
+	for (Iterator it = text_iterator_get(txt, pos);
+	     len > 0 && n < count && text_iterator_valid(&it);
+	     text_iterator_next(&it)) {
+		size_t piece_len = MIN((size_t)(it.end - it.text), len);
+		if (piece_len) {
+			strs[n++] = (TextString){ .data = it.text, .len = piece_len };
+			len -= piece_len;
+		}
+	}
+	return n;
+}
+
+bool text_iterate(Text *txt, size_t pos, size_t len, bool (*visit)(const TextString*, void *data), void *data) {
+	for (Iterator it = text_iterator_get(txt, pos);
+	     len > 0 && text_iterator_valid(&it);
+	     text_iterator_next(&it)) {
+		size_t piece_len = MIN((size_t)(it.end - it.text), len);
+		if (piece_len) {
+			TextString str = { .data = it.text, .len = piece_len };
+			if (!visit(&str, data))
+				return false;
+			len -= piece_len;
+		}
+	}
+	return true;
+}
+
 char *text_bytes_alloc0(Text *txt, size_t pos, size_t len) {
 	if (len == SIZE_MAX)
 		return NULL;
@@ -1627,6 +2350,18 @@ static size_t lines_skip_forward(Text *txt, size_t pos, size_t lines, size_t *li
 	return pos;
 }
 
+/* skip n lines backward from a position within a line and return the start
+ * of the line reached, the text must contain at least n preceding lines */
+static size_t lines_skip_backward(Text *txt, size_t pos, size_t lines) {
+	Iterator it = text_iterator_get(txt, pos);
+	/* the first newline found terminates the previous line */
+	for (lines++; lines > 0; lines--) {
+		if (!text_iterator_byte_find_prev(&it, '\n'))
+			return 0;
+	}
+	return it.pos + 1;
+}
+
 static void lineno_cache_invalidate(LineCache *cache) {
 	cache->pos = 0;
 	cache->lineno = 1;
@@ -1641,15 +2376,15 @@ size_t text_pos_by_lineno(Text *txt, size_t lineno) {
 		cache->pos = lines_skip_forward(txt, cache->pos, lineno - cache->lineno, &lines_skipped);
 		cache->lineno += lines_skipped;
 	} else if (lineno < cache->lineno) {
-	#if 0
-		// TODO does it make sense to scan memory backwards here?
+		/* scan backwards from the cached line if it is closer */
 		size_t diff = cache->lineno - lineno;
 		if (diff < lineno) {
-			lines_skip_backward(txt, cache->pos, diff);
-		} else
-	#endif
-		cache->pos = lines_skip_forward(txt, 0, lineno - 1, &lines_skipped);
-		cache->lineno = lines_skipped + 1;
+			cache->pos = lines_skip_backward(txt, cache->pos, diff);
+			cache->lineno = lineno;
+		} else {
+			cache->pos = lines_skip_forward(txt, 0, lineno - 1, &lines_skipped);
+			cache->lineno = lines_skipped + 1;
+		}
 	}
 	return cache->lineno == lineno ? cache->pos : EPOS;
 }
@@ -1671,6 +2406,270 @@ size_t text_lineno_by_pos(Text *txt, size_t pos) {
 	return cache->lineno;
 }
 
+/* count the number of new lines in data */
+static size_t newlines(const char *data, size_t len) {
+	size_t lines = 0;
+	for (const char *end = data + len; (data = memchr(data, '\n', end - data)); data++)
+		lines++;
+	return lines;
+}
+
+static bool line_table_reserve(LineTable *t, size_t count) {
+	if (count <= t->size)
+		return true;
+	size_t size = MAX(count, t->size * 2);
+	LineInfo *lines = realloc(t->lines, size * sizeof *lines);
+	if (!lines)
+		return false;
+	t->lines = lines;
+	t->size = size;
+	return true;
+}
+
+/* size the table according to the current line count, all entries invalid */
+static bool line_table_rebuild(Text *txt) {
+	LineTable *t = &txt->line_table;
+	size_t count = lines_count(txt, 0, txt->size) + 1;
+	if (!line_table_reserve(t, count))
+		return false;
+	for (size_t i = 0; i < count; i++)
+		t->lines[i].valid = false;
+	t->count = count;
+	t->stale = false;
+	return true;
+}
+
+/* line number of pos if the table has to be maintained, zero otherwise */
+static size_t line_table_lineno(Text *txt, size_t pos) {
+	if (!txt->line_table.enabled || txt->line_table.stale)
+		return 0;
+	return text_lineno_by_pos(txt, pos);
+}
+
+/* the new lines of lineno up to lineno+removed were replaced by lineno up to
+ * lineno+added, only the entries of those lines are invalidated */
+static void line_table_update(Text *txt, size_t lineno, size_t removed, size_t added) {
+	LineTable *t = &txt->line_table;
+	if (!lineno || !t->enabled || t->stale)
+		return;
+	size_t i = lineno - 1;
+	if (i + removed >= t->count || !line_table_reserve(t, t->count - removed + added)) {
+		t->stale = true;
+		return;
+	}
+	memmove(&t->lines[i+1+added], &t->lines[i+1+removed], (t->count - i - 1 - removed) * sizeof *t->lines);
+	for (size_t j = i; j <= i + added; j++)
+		t->lines[j].valid = false;
+	t->count = t->count - removed + added;
+}
+
+static void line_table_insert(Text *txt, size_t lineno, const char *data, size_t len) {
+	if (lineno)
+		line_table_update(txt, lineno, 0, newlines(data, len));
+}
+
+/* count the new lines of all pieces in span */
+static size_t span_newlines(Span *span) {
+	size_t lines = 0;
+	for (Piece *p = span->start; p; p = p->next) {
+		lines += newlines(p->data, p->len);
+		if (p == span->end)
+			break;
+	}
+	return lines;
+}
+
+/* account for span out, which is currently part of the chain, being
+ * replaced by span in, assumes both are linked, see span_relink */
+static void line_table_swap(Text *txt, Span *out, Span *in) {
+	LineTable *t = &txt->line_table;
+	if (!t->enabled || t->stale || (!out->len && !in->len))
+		return;
+	/* both spans share the same predecessor, determine its end */
+	Piece *prev = out->len ? out->start->prev : in->start->prev;
+	size_t pos = 0;
+	for (Piece *p = txt->begin.next; p != prev->next; p = p->next)
+		pos += p->len;
+	if (pos < txt->lines.pos)
+		lineno_cache_invalidate(&txt->lines);
+	size_t lineno = text_lineno_by_pos(txt, pos);
+	line_table_update(txt, lineno, span_newlines(out), span_newlines(in));
+}
+
+static void line_info_compute(Text *txt, size_t bol, TextLineInfo *info) {
+	size_t eol = text_line_end(txt, bol);
+	size_t sol = MIN(text_line_start(txt, bol), eol);
+	info->len = eol - bol;
+	info->width = text_line_width_get(txt, eol);
+	info->indent = text_line_width_get(txt, sol);
+	info->indent_len = sol - bol;
+	info->blank = sol == eol;
+	info->empty = bol == eol;
+}
+
+void text_line_info_enable(Text *txt, bool enable) {
+	LineTable *t = &txt->line_table;
+	if (!enable) {
+		free(t->lines);
+		*t = (LineTable){ 0 };
+	} else if (!t->enabled) {
+		t->enabled = true;
+		t->stale = true;
+	}
+}
+
+bool text_line_info(Text *txt, size_t pos, TextLineInfo *info) {
+	LineTable *t = &txt->line_table;
+	if (!t->enabled || pos > txt->size)
+		return false;
+	if (t->stale && !line_table_rebuild(txt))
+		return false;
+	size_t lineno = text_lineno_by_pos(txt, pos);
+	if (lineno - 1 >= t->count) {
+		t->stale = true;
+		return false;
+	}
+	LineInfo *l = &t->lines[lineno - 1];
+	if (!l->valid) {
+		/* the line number cache now points to the beginning of the line */
+		line_info_compute(txt, txt->lines.pos, &l->info);
+		l->valid = true;
+	}
+	*info = l->info;
+	return true;
+}
+
+static void column_cache_invalidate(ColumnCache *cache) {
+	for (int i = 0; i < TEXT_COLUMN_TYPES; i++)
+		cache->count[i] = 0;
+}
+
+/* removed bytes at pos were replaced by added ones */
+static void column_cache_update(Text *txt, size_t pos, size_t removed, size_t added) {
+	ColumnCache *cache = &txt->columns;
+	if (pos + removed < cache->bol) {
+		/* the new line in front of the tracked line is retained */
+		cache->bol = cache->bol - removed + added;
+		for (int i = 0; i < TEXT_COLUMN_TYPES; i++) {
+			for (size_t j = 0; j < cache->count[i]; j++)
+				cache->columns[i][j].pos = cache->columns[i][j].pos - removed + added;
+		}
+	} else if (pos < cache->bol) {
+		column_cache_invalidate(cache);
+	} else {
+		/* drop checkpoints whose character might extend into the change */
+		for (int i = 0; i < TEXT_COLUMN_TYPES; i++) {
+			while (cache->count[i] > 0 && cache->columns[i][cache->count[i]-1].pos + UTF8_LEN_MAX > pos)
+				cache->count[i]--;
+		}
+	}
+}
+
+const TextColumn *text_columns_get(Text *txt, size_t bol, enum TextColumnType type, size_t *count) {
+	ColumnCache *cache = &txt->columns;
+	*count = cache->bol == bol ? cache->count[type] : 0;
+	return *count ? cache->columns[type] : NULL;
+}
+
+bool text_columns_add(Text *txt, size_t bol, enum TextColumnType type, size_t pos, int value) {
+	ColumnCache *cache = &txt->columns;
+	if (pos <= bol || pos > txt->size)
+		return false;
+	if (cache->bol != bol) {
+		column_cache_invalidate(cache);
+		cache->bol = bol;
+	}
+	size_t count = cache->count[type];
+	if (count > 0 && cache->columns[type][count-1].pos >= pos)
+		return true;
+	if (count == cache->size[type]) {
+		size_t size = count ? 2 * count : 64;
+		TextColumn *columns = realloc(cache->columns[type], size * sizeof *columns);
+		if (!columns)
+			return false;
+		cache->columns[type] = columns;
+		cache->size[type] = size;
+	}
+	cache->columns[type][cache->count[type]++] = (TextColumn){ .pos = pos, .value = value };
+	return true;
+}
+
+static bool newline_visit(const TextString *str, void *data) {
+	return !memchr(str->data, '\n', str->len);
+}
+
+size_t text_columns_line_begin(Text *txt, size_t pos) {
+	ColumnCache *cache = &txt->columns;
+	size_t last = cache->bol;
+	if (pos < cache->bol || pos > txt->size)
+		return EPOS;
+	for (int i = 0; i < TEXT_COLUMN_TYPES; i++) {
+		size_t count = cache->count[i];
+		if (count > 0 && cache->columns[i][count-1].pos > last)
+			last = cache->columns[i][count-1].pos;
+	}
+	if (last == cache->bol)
+		return EPOS;
+	/* the tracked line extends at least up to its last checkpoint */
+	if (pos > last && !text_iterate(txt, last, pos - last, newline_visit, NULL))
+		return EPOS;
+	return cache->bol;
+}
+
+static void *profile_thread(void *arg) {
+	Profiler *prof = arg;
+	text_profile_compute(&prof->profile, prof->data, prof->len);
+	atomic_store(&prof->done, true);
+	return NULL;
+}
+
+/* profile the loaded file content, memory mapped files in the background
+ * as their pages might first have to be read from disk */
+static bool profile_start(Text *txt) {
+	Profiler *prof = &txt->profiler;
+	prof->data = txt->block ? txt->block->data : NULL;
+	prof->len = txt->block ? txt->block->len : 0;
+	size_t regions = (prof->len + TEXT_PROFILE_REGION - 1) / TEXT_PROFILE_REGION;
+	if (!(prof->profile.ascii = malloc(regions / 8 + 1)))
+		return false;
+	if (txt->block && txt->block->type == MMAP_ORIG &&
+	    pthread_create(&prof->thread, NULL, profile_thread, prof) == 0) {
+		prof->running = true;
+		return true;
+	}
+	profile_thread(prof);
+	return true;
+}
+
+const TextProfile *text_profile(Text *txt, bool wait) {
+	Profiler *prof = &txt->profiler;
+	if (prof->running && (wait || atomic_load(&prof->done))) {
+		pthread_join(prof->thread, NULL);
+		prof->running = false;
+	}
+	return atomic_load(&prof->done) ? &prof->profile : NULL;
+}
+
+static bool profile_ascii_visit(const TextString *str, void *data) {
+	Profiler *prof = data;
+	if (str->data < prof->data || str->data + str->len > prof->data + prof->len)
+		return false;
+	size_t first = (str->data - prof->data) / TEXT_PROFILE_REGION;
+	size_t last = (str->data + str->len - 1 - prof->data) / TEXT_PROFILE_REGION;
+	for (size_t i = first; i <= last; i++) {
+		if (!(prof->profile.ascii[i / 8] & (1 << (i % 8))))
+			return false;
+	}
+	return true;
+}
+
+bool text_profile_ascii(Text *txt, size_t pos, size_t len) {
+	size_t end;
+	if (!text_profile(txt, false) || !addu(pos, len, &end) || end > txt->size)
+		return false;
+	return text_iterate(txt, pos, len, profile_ascii_visit, &txt->profiler);
+}
+
 Mark text_mark_set(Text *txt, size_t pos) {
 	if (pos == txt->size)
 		return (Mark)&txt->end;
@@ -111,6 +111,20 @@ Text *text_load(const char *filename);
 Text *text_load_method(const char *filename, enum TextLoadMethod);
 /** Release all ressources associated with this text instance. */
 void text_free(Text*);
+/**
+ * Create a read only view of the current text content.
+ *
+ * The view shares the content with the text, but is not affected by later
+ * modifications of it. It can thus be read by another thread while the text
+ * is being edited.
+ * @rst
+ * .. note:: Views have to be freed using ``text_free`` before the text they
+ *           were created from. While any exist, modifications always allocate
+ *           new pieces and cold blocks are not compressed.
+ * @endrst
+ * @return The view or ``NULL`` in case of an error.
+ */
+Text *text_view(Text*);
 /**
  * @}
  * @defgroup state
@@ -153,9 +167,48 @@ bool text_insert(Text*, size_t pos, const char *data, size_t len);
  * @return Whether the deletion succeeded.
  */
 bool text_delete(Text*, size_t pos, size_t len);
+/**
+ * Insert a region of a file without copying it.
+ *
+ * The region is memory mapped read-only and referenced by a new piece.
+ *
+ * @param pos The absolute byte position.
+ * @param fd The file descriptor of a regular file, it can be closed afterwards.
+ * @param off The offset of the region within the file.
+ * @param len The length of the region in bytes.
+ * @return Whether the insertion succeeded.
+ * @rst
+ * .. warning:: The same caveats as for ``TEXT_LOAD_MMAP`` apply. Inplace
+ *              modifications of the underlying file will be reflected in
+ *              the current text content. In particular, truncatenation
+ *              will raise ``SIGBUS`` and result in data loss.
+ * @endrst
+ */
+bool text_insert_file(Text*, size_t pos, int fd, off_t off, size_t len);
 bool text_delete_range(Text*, Filerange*);
 bool text_printf(Text*, size_t pos, const char *format, ...) __attribute__((format(printf, 3, 4)));
 bool text_appendf(Text*, const char *format, ...) __attribute__((format(printf, 2, 3)));
+/**
+ * Function called after a modification.
+ *
+ * @param data The pointer given to ``text_listener_add``.
+ * @param pos The absolute byte position of the change.
+ * @param removed The number of bytes removed at ``pos``.
+ * @param added The number of bytes inserted at ``pos``, in place of them.
+ */
+typedef void (*TextChanged)(void *data, size_t pos, size_t removed, size_t added);
+/**
+ * Register a function to be called after every modification.
+ *
+ * Undo/redo operations report each of the changes they revert or reapply.
+ * @rst
+ * .. note:: The text already reflects the change. The function may read it,
+ *           but must neither modify it nor (un)register listeners.
+ * @endrst
+ */
+bool text_listener_add(Text*, TextChanged, void *data);
+/** Unregister a function added with ``text_listener_add``. */
+void text_listener_remove(Text*, TextChanged, void *data);
 /**
  * @}
  * @defgroup history
@@ -171,7 +224,8 @@ void text_snapshot(Text*);
  * .. note:: Takes an implicit snapshot.
  * @endrst
  * @return The position of the first change or ``EPOS``, if already at the
- *         oldest state i.e. there was nothing to undo.
+ *         oldest state i.e. there was nothing to undo, or if compressed
+ *         content of the previous state could not be restored.
  */
 size_t text_undo(Text*);
 /**
@@ -180,7 +234,8 @@ size_t text_undo(Text*);
  * .. note:: Takes an implicit snapshot.
  * @endrst
  * @return The position of the first change or ``EPOS``, if already at the
- *         newest state i.e. there was nothing to redo.
+ *         newest state i.e. there was nothing to redo, or if compressed
+ *         content of the next state could not be restored.
  */
 size_t text_redo(Text*);
 size_t text_earlier(Text*);
@@ -204,6 +259,76 @@ time_t text_state(Text*);
 size_t text_pos_by_lineno(Text*, size_t lineno);
 size_t text_lineno_by_pos(Text*, size_t pos);
 
+/** Metadata of a line, see ``text_line_info``. */
+typedef struct {
+	size_t len;        /**< Length in bytes, excluding the new line. */
+	int width;         /**< Display width, excluding the new line. */
+	int indent;        /**< Display width of the leading blanks. */
+	size_t indent_len; /**< Length in bytes of the leading blanks. */
+	bool blank;        /**< Whether the line only consists of blanks. */
+	bool empty;        /**< Whether the line is empty. */
+} TextLineInfo;
+
+/**
+ * Maintain a per line metadata table.
+ *
+ * Entries are computed on demand and only invalidated for lines
+ * touched by subsequent changes, including undo/redo operations.
+ * @rst
+ * .. note:: Disabled by default, disabling it frees the table.
+ * @endrst
+ */
+void text_line_info_enable(Text*, bool enable);
+/**
+ * Get metadata of the line containing ``pos``.
+ * @return Whether ``info`` was filled in, ``false`` if the table is
+ *         disabled. In that case callers should inspect the text itself.
+ */
+bool text_line_info(Text*, size_t pos, TextLineInfo *info);
+
+/** Kinds of column checkpoints, see ``text_columns_get``. */
+enum TextColumnType {
+	TEXT_COLUMN_WIDTH, /**< Display width of the line up to ``pos``, see ``text_line_width_get``. */
+	TEXT_COLUMN_CHARS, /**< Number of characters up to ``pos``, see ``text_line_char_get``. */
+	TEXT_COLUMN_TYPES,
+};
+
+/** A position within a line along with its column. */
+typedef struct {
+	size_t pos;        /**< Absolute position of a character start. */
+	int value;         /**< Column of ``pos``, depending on the checkpoint type. */
+} TextColumn;
+
+/**
+ * Get the column checkpoints of a line.
+ *
+ * Only one, typically very long, line is tracked at a time. Its checkpoints
+ * are adjusted when changes happen before it and truncated when the line
+ * itself is modified. Undo/redo operations drop them.
+ * @param bol The start of the line.
+ * @param count Set to the number of checkpoints.
+ * @return The checkpoints sorted by position, ``NULL`` if there are none.
+ * @rst
+ * .. warning:: Only valid until the next modification or ``text_columns_add``.
+ * @endrst
+ */
+const TextColumn *text_columns_get(Text*, size_t bol, enum TextColumnType, size_t *count);
+/**
+ * Record a column checkpoint, dropping those of any other line.
+ * @param bol The start of the line.
+ * @param pos A character start after ``bol``, a checkpoint for a position
+ *            before the last recorded one is ignored.
+ * @param value The column of ``pos``.
+ */
+bool text_columns_add(Text*, size_t bol, enum TextColumnType, size_t pos, int value);
+/**
+ * Get the start of the line containing ``pos``, if it is the tracked line.
+ *
+ * Only the part after the last checkpoint needs to be scanned for newlines.
+ * @return The line start or ``EPOS`` if unknown.
+ */
+size_t text_columns_line_begin(Text*, size_t pos);
+
 /**
  * @}
  * @defgroup access
@@ -242,6 +367,31 @@ size_t text_bytes_get(Text*, size_t pos, size_t len, char *buf);
  * @endrst
  */
 char *text_bytes_alloc0(Text*, size_t pos, size_t len);
+/**
+ * Get the contiguous parts making up a text range, without copying them.
+ * @param pos The absolute starting position.
+ * @param len The length in bytes.
+ * @param strs The destination array.
+ * @param count The capacity of ``strs``.
+ * @return The number of parts (``<= count``) stored in ``strs``.
+ * @rst
+ * .. warning:: The parts point into the text itself and are only valid
+ *              until the next modification.
+ * @endrst
+ */
+size_t text_strings_get(Text*, size_t pos, size_t len, TextString *strs, size_t count);
+/**
+ * Invoke ``visit`` for every contiguous part of a text range, in order.
+ * @param pos The absolute starting position.
+ * @param len The length in bytes.
+ * @param visit The callback, returning ``false`` stops the iteration.
+ * @param data Arbitrary pointer passed on to ``visit``.
+ * @return Whether the whole range was visited.
+ * @rst
+ * .. warning:: The text must not be modified from within ``visit``.
+ * @endrst
+ */
+bool text_iterate(Text*, size_t pos, size_t len, bool (*visit)(const TextString*, void *data), void *data);
 /**
  * @}
  * @defgroup iterator
@@ -275,6 +425,31 @@ bool text_iterator_codepoint_prev(Iterator *it, char *c);
  */
 bool text_iterator_char_next(Iterator*, char *c);
 bool text_iterator_char_prev(Iterator*, char *c);
+/**
+ * Advance the iterator over a run of printable ASCII characters within the
+ * current piece.
+ * @param max The maximal number of characters to skip.
+ * @return The number of characters skipped, each of them amounts to one
+ *         ``text_iterator_char_next`` call. Zero if the run ends at the
+ *         current position, in which case the caller should fall back to
+ *         ``text_iterator_char_next``.
+ */
+size_t text_iterator_ascii_next(Iterator*, size_t max);
+/**
+ * Advance the iterator over a run of bytes within the current piece.
+ * @param run Returns the length of the run at the start of the given bytes.
+ *            The run must solely consist of ASCII characters, each of them
+ *            amounts to one ``text_iterator_char_next`` call.
+ * @return The number of characters skipped, the iterator is left on the last
+ *         byte of the run.
+ */
+size_t text_iterator_run_next(Iterator*, size_t (*run)(const char *s, size_t len, void *data), void *data);
+/**
+ * Same as ``text_iterator_run_next`` but in the opposite direction.
+ * @param run Returns the length of the run at the end of the given bytes,
+ *            the last of which is the one at the current position.
+ */
+size_t text_iterator_run_prev(Iterator*, size_t (*run)(const char *s, size_t len, void *data), void *data);
 /**
  * @}
  * @defgroup mark
@@ -400,6 +575,59 @@ ssize_t text_write_range(Text*, Filerange*, int fd);
  * this text instance.
  */
 bool text_mmaped(Text*, const char *ptr);
+/** Information about compressed insertion blocks. */
+typedef struct {
+	size_t blocks;       /**< Number of currently compressed blocks. */
+	size_t size;         /**< Uncompressed size of their content in bytes. */
+	size_t compressed;   /**< Compressed size of their content in bytes. */
+	size_t decompressed; /**< Number of blocks decompressed on demand so far. */
+} TextCompressStats;
+/**
+ * Compress insertion blocks which are only referenced from the undo history.
+ *
+ * Blocks which are not referenced by the current text content and have not
+ * been accessed for a while are periodically compressed when taking a
+ * snapshot. They are transparently decompressed once an undo/redo operation
+ * brings their content back.
+ * @rst
+ * .. note:: Disabled by default, disabling it does not decompress any blocks.
+ * @endrst
+ */
+void text_compress_cold(Text*, bool enable);
+/** Get compression statistics, ``compressed / size`` is the achieved ratio. */
+TextCompressStats text_compress_stats(Text*);
+/** Size in bytes of the regions tracked by ``TextProfile.ascii``. */
+#define TEXT_PROFILE_REGION (64*1024)
+/** Statistics about the loaded file content. */
+typedef struct {
+	size_t size;        /**< Size of the profiled content in bytes. */
+	size_t lines;       /**< Number of newline characters. */
+	size_t longest;     /**< Length of the longest line in bytes, excluding its newline. */
+	size_t longest_pos; /**< Start of the longest line. */
+	size_t nul;         /**< Number of NUL bytes. */
+	size_t crlf;        /**< Number of lines terminated by ``\r\n``. */
+	size_t non_ascii;   /**< Number of bytes outside of the ASCII range. */
+	size_t invalid;     /**< Number of invalid or truncated UTF-8 sequences. */
+	uint8_t *ascii;     /**< Bitmap of regions without non-ASCII bytes, bit ``i % 8``
+	                         of ``ascii[i / 8]`` is set if region ``i`` is pure ASCII. */
+} TextProfile;
+/**
+ * Get statistics about the file content as it was loaded.
+ *
+ * They are computed in a single pass at load time. For memory mapped
+ * files this happens in a background thread.
+ * @param wait Whether to block until a background computation is complete.
+ * @return The statistics or ``NULL`` if they are not yet available.
+ */
+const TextProfile *text_profile(Text*, bool wait);
+/**
+ * Check whether a range is known to consist of ASCII characters only.
+ *
+ * Only parts referring to the loaded file content are taken into account.
+ * @return ``false`` if the range contains non-ASCII characters, inserted
+ *         content or the profile is not yet available.
+ */
+bool text_profile_ascii(Text*, size_t pos, size_t len);
 /** @} */
 
 #endif
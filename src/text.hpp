@@ -0,0 +1,289 @@
+#ifndef TEXT_HPP
+#define TEXT_HPP
+
+/* header only C++20 interface to the text core. the underlying Text is owned
+ * by a move only handle, its content is exposed as a bidirectional range of
+ * bytes and as a range of contiguous chunks, one per piece, which standard
+ * algorithms can process without materializing the text.
+ *
+ * as with the C interface, any modification of the text invalidates all
+ * iterators and chunks obtained from it. */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+extern "C" {
+#include "text.h"
+}
+
+namespace text {
+
+/* bidirectional iterator over the bytes of a text */
+class ByteIterator {
+public:
+	using iterator_concept = std::bidirectional_iterator_tag;
+	using iterator_category = std::input_iterator_tag;
+	using value_type = char;
+	using difference_type = std::ptrdiff_t;
+	using reference = char;
+
+	ByteIterator() = default;
+	ByteIterator(::Text *txt, size_t pos) : it(text_iterator_get(txt, pos)) {}
+
+	char operator*() const {
+		char c = '\0';
+		text_iterator_byte_get(const_cast<Iterator*>(&it), &c);
+		return c;
+	}
+
+	ByteIterator& operator++() {
+		text_iterator_byte_next(&it, nullptr);
+		return *this;
+	}
+
+	ByteIterator operator++(int) {
+		ByteIterator tmp = *this;
+		++*this;
+		return tmp;
+	}
+
+	ByteIterator& operator--() {
+		text_iterator_byte_prev(&it, nullptr);
+		return *this;
+	}
+
+	ByteIterator operator--(int) {
+		ByteIterator tmp = *this;
+		--*this;
+		return tmp;
+	}
+
+	/* absolute position in bytes from the start of the text */
+	size_t pos() const { return it.pos; }
+
+	friend bool operator==(const ByteIterator &a, const ByteIterator &b) {
+		return a.it.pos == b.it.pos;
+	}
+
+private:
+	Iterator it = {};
+};
+
+/* bytes in [start, end) of a text */
+class ByteRange : public std::ranges::view_interface<ByteRange> {
+public:
+	ByteRange() = default;
+	ByteRange(::Text *txt, size_t start, size_t end) : txt(txt), start(start), stop(end) {}
+
+	ByteIterator begin() const { return ByteIterator(txt, start); }
+	ByteIterator end() const { return ByteIterator(txt, stop); }
+	size_t size() const { return stop - start; }
+
+private:
+	::Text *txt = nullptr;
+	size_t start = 0, stop = 0;
+};
+
+/* forward iterator yielding the contiguous parts of a range as string views,
+ * empty pieces are skipped */
+class ChunkIterator {
+public:
+	using iterator_concept = std::forward_iterator_tag;
+	using iterator_category = std::input_iterator_tag;
+	using value_type = std::string_view;
+	using difference_type = std::ptrdiff_t;
+	using reference = std::string_view;
+
+	ChunkIterator() = default;
+	ChunkIterator(::Text *txt, size_t start, size_t end) : it(text_iterator_get(txt, start)), stop(end) {
+		skip();
+	}
+
+	std::string_view operator*() const {
+		size_t len = std::min(static_cast<size_t>(it.end - it.text), stop - it.pos);
+		return std::string_view(it.text, len);
+	}
+
+	ChunkIterator& operator++() {
+		text_iterator_next(&it);
+		skip();
+		return *this;
+	}
+
+	ChunkIterator operator++(int) {
+		ChunkIterator tmp = *this;
+		++*this;
+		return tmp;
+	}
+
+	/* absolute position of the first byte of the current chunk */
+	size_t pos() const { return it.pos; }
+
+	friend bool operator==(const ChunkIterator &a, const ChunkIterator &b) {
+		return a.done() ? b.done() : !b.done() && a.it.pos == b.it.pos;
+	}
+
+	friend bool operator==(const ChunkIterator &a, std::default_sentinel_t) {
+		return a.done();
+	}
+
+private:
+	bool done() const {
+		return !text_iterator_valid(&it) || it.pos >= stop;
+	}
+
+	void skip() {
+		while (!done() && it.text >= it.end)
+			text_iterator_next(&it);
+	}
+
+	Iterator it = {};
+	size_t stop = 0;
+};
+
+/* chunks of [start, end) of a text */
+class ChunkRange : public std::ranges::view_interface<ChunkRange> {
+public:
+	ChunkRange() = default;
+	ChunkRange(::Text *txt, size_t start, size_t end) : txt(txt), start(start), stop(end) {}
+
+	ChunkIterator begin() const { return txt ? ChunkIterator(txt, start, stop) : ChunkIterator(); }
+	std::default_sentinel_t end() const { return std::default_sentinel; }
+
+private:
+	::Text *txt = nullptr;
+	size_t start = 0, stop = 0;
+};
+
+/* owning handle of a Text */
+class Text {
+public:
+	static constexpr size_t npos = EPOS;
+
+	/* load the given file, or create an empty text if filename is NULL */
+	explicit Text(const char *filename = nullptr, enum TextLoadMethod method = TEXT_LOAD_AUTO)
+		: txt(text_load_method(filename, method)) {
+		if (!txt)
+			throw std::system_error(errno, std::generic_category(), "text_load");
+	}
+
+	/* take ownership of an existing text */
+	explicit Text(::Text *txt) noexcept : txt(txt) {}
+
+	Text(const Text&) = delete;
+	Text& operator=(const Text&) = delete;
+
+	Text(Text &&other) noexcept : txt(std::exchange(other.txt, nullptr)) {}
+
+	Text& operator=(Text &&other) noexcept {
+		if (this != &other) {
+			if (txt)
+				text_free(txt);
+			txt = std::exchange(other.txt, nullptr);
+		}
+		return *this;
+	}
+
+	~Text() {
+		if (txt)
+			text_free(txt);
+	}
+
+	::Text *get() const noexcept { return txt; }
+	::Text *release() noexcept { return std::exchange(txt, nullptr); }
+
+	size_t size() const { return text_size(txt); }
+	bool insert(size_t pos, std::string_view data) { return text_insert(txt, pos, data.data(), data.size()); }
+	bool erase(size_t pos, size_t len) { return text_delete(txt, pos, len); }
+	void snapshot() { text_snapshot(txt); }
+	size_t undo() { return text_undo(txt); }
+	size_t redo() { return text_redo(txt); }
+	bool save(const char *filename) { return text_save(txt, filename); }
+
+	/* bytes of [pos, pos+len), clamped to the end of the text */
+	ByteRange bytes(size_t pos = 0, size_t len = npos) const {
+		auto [start, end] = clamp(pos, len);
+		return ByteRange(txt, start, end);
+	}
+
+	/* contiguous chunks of [pos, pos+len), clamped to the end of the text */
+	ChunkRange chunks(size_t pos = 0, size_t len = npos) const {
+		auto [start, end] = clamp(pos, len);
+		return ChunkRange(txt, start, end);
+	}
+
+	/* copy [pos, pos+len) into a string */
+	std::string str(size_t pos = 0, size_t len = npos) const {
+		std::string s;
+		for (std::string_view chunk : chunks(pos, len))
+			s.append(chunk);
+		return s;
+	}
+
+	/* position of the first occurrence of needle within [pos, pos+len) or
+	 * npos. each chunk is searched directly, only occurrences straddling
+	 * a chunk boundary are matched against a small stitched window */
+	size_t find(std::string_view needle, size_t pos = 0, size_t len = npos) const {
+		auto [start, end] = clamp(pos, len);
+		if (needle.empty())
+			return start;
+		std::boyer_moore_horspool_searcher searcher(needle.begin(), needle.end());
+		size_t keep = needle.size() - 1;
+		std::string window;     /* tail of the preceding chunks */
+		size_t window_pos = start;
+		size_t chunk_pos = start;
+		for (std::string_view chunk : chunks(start, end - start)) {
+			if (!window.empty()) {
+				/* occurrences starting in the window and ending in this chunk */
+				size_t old = window.size();
+				window.append(chunk.substr(0, keep));
+				auto match = searcher(window.begin(), window.end()).first;
+				if (match != window.end())
+					return window_pos + (match - window.begin());
+				window.resize(old);
+			}
+			auto match = searcher(chunk.begin(), chunk.end()).first;
+			if (match != chunk.end())
+				return chunk_pos + (match - chunk.begin());
+			if (chunk.size() >= keep) {
+				window.assign(chunk.substr(chunk.size() - keep));
+			} else {
+				window.append(chunk);
+				window.erase(0, window.size() - std::min(window.size(), keep));
+			}
+			chunk_pos += chunk.size();
+			window_pos = chunk_pos - window.size();
+		}
+		return npos;
+	}
+
+private:
+	std::pair<size_t, size_t> clamp(size_t pos, size_t len) const {
+		size_t size = text_size(txt);
+		size_t start = std::min(pos, size);
+		return { start, start + std::min(len, size - start) };
+	}
+
+	::Text *txt = nullptr;
+};
+
+static_assert(std::bidirectional_iterator<ByteIterator>);
+static_assert(std::ranges::bidirectional_range<ByteRange>);
+static_assert(std::forward_iterator<ChunkIterator>);
+static_assert(std::ranges::forward_range<ChunkRange>);
+
+}
+
+/* iterators refer to the text, not to the range object they came from */
+template<> inline constexpr bool std::ranges::enable_borrowed_range<text::ByteRange> = true;
+template<> inline constexpr bool std::ranges::enable_borrowed_range<text::ChunkRange> = true;
+
+#endif
@@ -16,6 +16,9 @@
 
 #include "text.h"
 #include "text-motions.h"
+#include "text-regex-cache.h"
+#include "text-match-index.h"
+#include "text-find.h"
 #include "vsm.h"
 #include "util.h"
 
@@ -206,9 +209,12 @@ void vsm_init() {
 	vsm.styles = styles;
 
 	vsm.view.text = text_load("src/vsm.c");
+	text_line_info_enable(vsm.view.text, true);
 	vsm.view.off_y = 1;
 	vsm.view.pos = 0;
+	vsm.view.col = EPOS;
 	vsm.view.tabwidth = 4;
+	vsm.regexes = text_regex_cache_new(16);
 }
 
 void ui_exit() {
@@ -253,61 +259,91 @@ void ui_exit() {
 // 	return true;
 // }
 
-void vsm_draw() {
-	size_t linepos = text_pos_by_lineno(vsm.view.text, vsm.view.off_y);
-	/* read a screenful of text considering each character as 4-byte UTF character*/
-	const size_t size = vsm.width * vsm.height * 4;
-	/* current buffer to work with */
-	char text[size+1];
-	/* remaining bytes to process in buffer */
-	size_t rem = text_bytes_get(vsm.view.text, linepos, size, text);
-	/* NUL terminate text section */
-	text[rem] = '\0';
-
-	char* hd = text;
-
-	int x = 0;
-	int y = 0;
-
+/* state of a screen redraw, fed piece by piece via text_iterate */
+typedef struct {
+	size_t pos;      /* absolute position of the pending character */
+	char data[16];   /* pending character, truncated to the cell size */
+	size_t len;      /* its length in bytes, including truncated ones */
+	int x, y;
+	const RegexMatch *matches; /* highlighted matches not yet passed */
+	size_t count;
+} Draw;
+
+/* draw the pending character, returns false once the screen is full */
+static bool vsm_draw_char(Draw *d) {
 	Cell (*cells)[vsm.width] = (void*)vsm.cells;
 	const size_t cell_size = sizeof(cells[0][0].data)-1;
-	for (const char *next = hd; *hd && x < vsm.width && y < vsm.height - 1; hd = next, linepos++) {
-		CellStyle style = vsm.styles[UI_STYLE_LEXER_MAX];
-		if (linepos == vsm.view.pos) {
-			style = vsm.styles[UI_STYLE_CURSOR];
-		}
-		do next++; while (!ISUTF8(*next));
-		size_t len = next - hd;
-		if (!len)
-			break;
-		len = MIN(len, cell_size);
-		if (*hd == '\n') {
-			// draw a space
-			strncpy(cells[y][x].data, " ", len);
-			cells[y][x].style = style;
-			x++;
-			// then draw newline
+	const char *hd = d->data;
+	size_t len = MIN(d->len, cell_size);
+	int x = d->x, y = d->y;
+	CellStyle style = vsm.styles[UI_STYLE_LEXER_MAX];
+	while (d->count > 0 && d->matches->end <= d->pos) {
+		d->matches++;
+		d->count--;
+	}
+	if (d->count > 0 && d->matches->start <= d->pos)
+		style = vsm.styles[UI_STYLE_SELECTION];
+	if (d->pos == vsm.view.pos) {
+		style = vsm.styles[UI_STYLE_CURSOR];
+	}
+	d->pos += d->len;
+	d->len = 0;
+	if (*hd == '\n') {
+		// draw a space
+		strncpy(cells[y][x].data, " ", len);
+		cells[y][x].style = style;
+		x++;
+		// then draw newline
+		strncpy(cells[y][x].data, hd, len);
+		cells[y][x].data[len] = '\0';
+		cells[y][x].style = style;
+		y++;
+		x=0;
+	} else if (*hd == '\t') {
+		int width = vsm.view.tabwidth - (x % vsm.view.tabwidth);
+		for (int i = 0; i < width; i++) {
 			strncpy(cells[y][x].data, hd, len);
-			cells[y][x].data[len] = '\0';
-			cells[y][x].style = style;
-			y++;
-			x=0;
-			continue;
-		}
-		if (*hd == '\t') {
-			int width = vsm.view.tabwidth - (x % vsm.view.tabwidth);
-			for (int i = 0; i < width; i++) {
-				strncpy(cells[y][x].data, hd, len);
-				cells[y][x++].style = style;
-			}
-			continue;
+			cells[y][x++].style = style;
 		}
-
+	} else {
 		strncpy(cells[y][x].data, hd, len);
 		cells[y][x].data[len] = '\0';
 		cells[y][x].style = style;
 		x++;
 	}
+	d->x = x;
+	d->y = y;
+	return x < vsm.width && y < vsm.height - 1;
+}
+
+static bool vsm_draw_visit(const TextString *str, void *data) {
+	Draw *d = data;
+	const size_t cell_size = sizeof(d->data)-1;
+	for (const char *s = str->data, *end = s + str->len; s < end; s++) {
+		/* a character is complete once the next one starts */
+		if (d->len && ISUTF8(*s) && !vsm_draw_char(d))
+			return false;
+		if (!*s)
+			return false;
+		if (d->len < cell_size)
+			d->data[d->len] = *s;
+		d->len++;
+	}
+	return true;
+}
+
+void vsm_draw() {
+	size_t linepos = text_pos_by_lineno(vsm.view.text, vsm.view.off_y);
+	Draw d = { .pos = linepos };
+	if (vsm.width <= 0 || vsm.height <= 1)
+		return;
+	if (vsm.matches) {
+		size_t end = text_pos_by_lineno(vsm.view.text, vsm.view.off_y + vsm.height);
+		d.matches = text_match_index_get(vsm.matches, linepos, end - linepos, &d.count);
+	}
+	/* render straight from the pieces, stopping once the screen is full */
+	if (text_iterate(vsm.view.text, linepos, text_size(vsm.view.text) - linepos, vsm_draw_visit, &d) && d.len)
+		vsm_draw_char(&d);
 
 	// size_t pos = text_mark_get(vsm.view.text, vsm.view.pos);
 	// if (!view_coord_get(view, pos, &s->line, &s->row, &s->col) &&
@@ -322,54 +358,158 @@ void ui_clear() {
 	erase();
 }
 
-void view_line_down(View *view) {
-	int width = text_line_width_get(view->text, view->pos) + 1;
-	size_t next = text_line_next(view->text, view->pos);
-	view->pos = text_line_width_set(view->text, next, width);
+/* move the cursor horizontally, forgetting the column vertical motions aim for */
+static void view_cursor_to(View *view, size_t pos) {
+	view->pos = pos;
+	view->col = EPOS;
+}
+/* move the cursor to the desired column of the line containing pos */
+static void view_cursor_line(View *view, size_t pos) {
+	TextLineInfo info;
+	if (view->col == EPOS)
+		view->col = text_line_width_get(view->text, view->pos);
+	int width = view->col + 1;
+	if (text_line_info(view->text, pos, &info) && info.width < width)
+		view->pos = text_line_begin(view->text, pos) + info.len;
+	else
+		view->pos = text_line_width_set(view->text, pos, width);
 }
-void view_line_up(View *view) {
-	int width = text_line_width_get(view->text, view->pos) + 1;
-	size_t prev = text_line_prev(view->text, view->pos);
-	view->pos = text_line_width_set(view->text, prev, width);
+void view_line_down(View *view, size_t count) {
+	view_cursor_line(view, text_line_next_n(view->text, view->pos, count));
 }
-void view_char_prev(View *view) {
-	view->pos = text_char_prev(view->text, view->pos);
+void view_line_up(View *view, size_t count) {
+	view_cursor_line(view, text_line_prev_n(view->text, view->pos, count));
 }
-void view_char_next(View *view) {
-	view->pos = text_char_next(view->text, view->pos);
+void view_char_prev(View *view, size_t count) {
+	view_cursor_to(view, text_char_prev_n(view->text, view->pos, count));
 }
-void view_longword_end_next(View *view) {
-	view->pos = text_customword_end_next(view->text, view->pos, isspace);
+void view_char_next(View *view, size_t count) {
+	view_cursor_to(view, text_char_next_n(view->text, view->pos, count));
 }
-void view_e(View* view) {
-	view->pos = text_customword_end_next(view->text, view->pos, is_word_boundary);
+void view_longword_end_next(View *view, size_t count) {
+	view_cursor_to(view, text_longword_end_next_n(view->text, view->pos, count));
 }
-void view_E(View* view) {
-	view->pos = text_customword_end_next(view->text, view->pos, isspace);
+void view_e(View* view, size_t count) {
+	view_cursor_to(view, text_word_end_next_n(view->text, view->pos, count));
 }
-void view_b(View* view) {
-	view->pos = text_customword_start_prev(view->text, view->pos, is_word_boundary);
+void view_E(View* view, size_t count) {
+	view_cursor_to(view, text_longword_end_next_n(view->text, view->pos, count));
 }
-void view_B(View* view) {
-	view->pos = text_customword_start_prev(view->text, view->pos, isspace);
+void view_b(View* view, size_t count) {
+	view_cursor_to(view, text_word_start_prev_n(view->text, view->pos, count));
 }
-void view_w(View* view) {
-	view->pos = text_customword_start_next(view->text, view->pos, is_word_boundary);
+void view_B(View* view, size_t count) {
+	view_cursor_to(view, text_longword_start_prev_n(view->text, view->pos, count));
 }
-void view_W(View* view) {
-	view->pos = text_customword_start_next(view->text, view->pos, isspace);
+void view_w(View* view, size_t count) {
+	view_cursor_to(view, text_word_start_next_n(view->text, view->pos, count));
+}
+void view_W(View* view, size_t count) {
+	view_cursor_to(view, text_longword_start_next_n(view->text, view->pos, count));
 }
 void view_line_begin(View* view) {
-	view->pos = text_line_begin(view->text, view->pos);
+	view_cursor_to(view, text_line_begin(view->text, view->pos));
+}
+/* end of the line count-1 lines below the cursor */
+void view_line_end(View* view, size_t count) {
+	size_t pos = count > 1 ? text_line_next_n(view->text, view->pos, count - 1) : view->pos;
+	view_cursor_to(view, text_line_end(view->text, pos));
+}
+void view_para_prev(View* view, size_t count) {
+	view_cursor_to(view, text_paragraph_prev_n(view->text, view->pos, count));
+}
+void view_para_next(View* view, size_t count) {
+	view_cursor_to(view, text_paragraph_next_n(view->text, view->pos, count));
+}
+/* jump to the count-th match of the last search pattern, searching in the
+ * direction of the last search unless reverse is set */
+void vsm_search(size_t count, bool reverse) {
+	View *view = &vsm.view;
+	bool backward = vsm.search_backward != reverse;
+	if (!vsm.search[0]) {
+		snprintf(vsm.message, sizeof(vsm.message), "no previous search pattern");
+		return;
+	}
+	int error;
+	Regex *regex = text_regex_cache_get(vsm.regexes, vsm.search, REG_EXTENDED|REG_NEWLINE, &error);
+	if (!regex) {
+		snprintf(vsm.message, sizeof(vsm.message), "invalid pattern: %s", vsm.search);
+		return;
+	}
+	size_t pos = view->pos;
+	for (size_t i = 0; i < count; i++) {
+		size_t next = backward ? text_search_backward(view->text, pos, regex) : text_search_forward(view->text, pos, regex);
+		if (next == pos)
+			break;
+		pos = next;
+	}
+	text_regex_cache_release(vsm.regexes, regex);
+	if (pos == view->pos)
+		snprintf(vsm.message, sizeof(vsm.message), "pattern not found: %s", vsm.search);
+	else
+		view_cursor_to(view, pos);
 }
-void view_line_end(View* view) {
-	view->pos = text_line_end(view->text, view->pos);
+/* highlight the matches of the last search pattern */
+static void vsm_highlight() {
+	text_match_index_free(vsm.matches);
+	vsm.matches = NULL;
+	if (vsm.highlight)
+		text_regex_cache_release(vsm.regexes, vsm.highlight);
+	vsm.highlight = text_regex_cache_get(vsm.regexes, vsm.search, REG_EXTENDED|REG_NEWLINE, NULL);
+	if (vsm.highlight)
+		vsm.matches = text_match_index_new(vsm.view.text, vsm.highlight, 0);
 }
-void view_para_prev(View* view) {
-	view->pos = text_paragraph_prev(view->text, view->pos);
+/* whether the pattern matches itself literally */
+static bool vsm_literal(const char *pattern) {
+	return !pattern[strcspn(pattern, "\\^$.[]|()*+?{}")];
 }
-void view_para_next(View* view) {
-	view->pos = text_paragraph_next(view->text, view->pos);
+/* read a search pattern on the info line, returns false if it is aborted.
+ * while a forward search is typed the cursor follows the first match of
+ * literal patterns, it is restored unless the pattern is accepted */
+static bool vsm_prompt(char prefix, char *buf, size_t size) {
+	size_t len = 0, pos = vsm.view.pos;
+	FindSession *session = prefix == '/' ? text_find_session_new(vsm.view.text, pos) : NULL;
+	bool accept = false;
+	buf[0] = '\0';
+	for (;;) {
+		ui_clear();
+		memset(vsm.cells, 0, vsm.cells_size);
+		vsm_info("%c%s", prefix, buf);
+		vsm_draw();
+		ui_draw();
+		int ch = getch();
+		switch (ch) {
+		case 27: /* escape */
+			goto out;
+		case '\r':
+		case '\n':
+		case KEY_ENTER:
+			accept = len > 0;
+			goto out;
+		case KEY_BACKSPACE:
+		case 127:
+		case 8:
+			if (!len)
+				goto out;
+			buf[--len] = '\0';
+			break;
+		default:
+			if (ch >= 0 && ch < 256 && (isprint(ch) || ch >= 0x80) && len + 1 < size) {
+				buf[len++] = ch;
+				buf[len] = '\0';
+			}
+			break;
+		}
+		if (session) {
+			size_t match = vsm_literal(buf) ? text_find_session_update(session, buf) : EPOS;
+			view_cursor_to(&vsm.view, match == EPOS ? pos : match);
+		}
+	}
+out:
+	if (!accept)
+		view_cursor_to(&vsm.view, pos);
+	text_find_session_free(session);
+	return accept;
 }
 
 
@@ -382,52 +522,87 @@ int main() {
 	for(;;) {
 		ui_clear();
 		memset(vsm.cells, 0, vsm.cells_size);
-		vsm_info("example %d", vsm.view.off_y);
+		const TextProfile *profile = text_profile(vsm.view.text, false);
+		if (vsm.message[0]) {
+			vsm_info("%s", vsm.message);
+			vsm.message[0] = '\0';
+		} else if (profile)
+			vsm_info("example %d, %zu lines%s", vsm.view.off_y, profile->lines, profile->crlf ? " [crlf]" : "");
+		else
+			vsm_info("example %d", vsm.view.off_y);
 		vsm_draw();
 		ui_draw();
-		ch = getch();
+		/* a count prefix applies to the following motion which is executed
+		 * as a single jump, a leading 0 moves to the begin of the line */
+		size_t count = 0;
+		while ((ch = getch()) >= '0' && ch <= '9' && (count || ch != '0'))
+			count = count < SIZE_MAX / 10 ? 10 * count + (ch - '0') : SIZE_MAX;
+		if (!count)
+			count = 1;
 		switch (ch) {
 			case 'j':
-				view_line_down(&vsm.view);
+				view_line_down(&vsm.view, count);
 				break;
 			case 'k':
-				view_line_up(&vsm.view);
+				view_line_up(&vsm.view, count);
 				break;
 			case 'h':
-				view_char_prev(&vsm.view);
+				view_char_prev(&vsm.view, count);
 				break;
 			case 'l':
-				view_char_next(&vsm.view);
+				view_char_next(&vsm.view, count);
 				break;
 			case 'e':
-				view_e(&vsm.view);
+				view_e(&vsm.view, count);
 				break;
 			case 'E':
-				view_E(&vsm.view);
+				view_E(&vsm.view, count);
 				break;
 			case 'b':
-				view_b(&vsm.view);
+				view_b(&vsm.view, count);
 				break;
 			case 'B':
-				view_B(&vsm.view);
+				view_B(&vsm.view, count);
 				break;
 			case 'w':
-				view_w(&vsm.view);
+				view_w(&vsm.view, count);
 				break;
 			case 'W':
-				view_W(&vsm.view);
+				view_W(&vsm.view, count);
 				break;
 			case '0':
 				view_line_begin(&vsm.view);
 				break;
 			case '$':
-				view_line_end(&vsm.view);
+				view_line_end(&vsm.view, count);
 				break;
 			case '{':
-				view_para_prev(&vsm.view);
+				view_para_prev(&vsm.view, count);
 				break;
 			case '}':
-				view_para_next(&vsm.view);
+				view_para_next(&vsm.view, count);
+				break;
+			case '/':
+			case '?': {
+				char search[sizeof(vsm.search)];
+				size_t pos = vsm.view.pos;
+				if (vsm_prompt(ch, search, sizeof(search))) {
+					strcpy(vsm.search, search);
+					vsm.search_backward = ch == '?';
+					vsm_highlight();
+					/* the cursor already is at the first match found while typing */
+					if (vsm.view.pos != pos)
+						count--;
+					if (count > 0)
+						vsm_search(count, false);
+				}
+				break;
+			}
+			case 'n':
+				vsm_search(count, false);
+				break;
+			case 'N':
+				vsm_search(count, true);
 				break;
 			case 'q':
 				goto exit;
@@ -435,4 +610,6 @@ int main() {
 	}
 exit:
 	ui_exit();
+	text_match_index_free(vsm.matches);
+	text_regex_cache_free(vsm.regexes);
 }
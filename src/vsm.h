@@ -32,7 +32,7 @@ typedef struct View {
 	size_t off_y;
 	size_t pos;         /* cursor position in text */
 	size_t tabwidth;
-	size_t col;
+	size_t col;         /* display column vertical motions aim for, EPOS if unset */
 } View;
 
 typedef struct Vsm {
@@ -43,6 +43,13 @@ typedef struct Vsm {
 
 	View view;
 
+	RegexCache *regexes;    /* compiled search patterns */
+	char search[256];       /* last search pattern, empty if none */
+	Regex *highlight;       /* its expression, referenced from regexes */
+	MatchIndex *matches;    /* its matches which are highlighted */
+	bool search_backward;   /* direction of the last search */
+	char message[MAX_WIDTH]; /* shown instead of the status line once */
+
 	size_t styles_size;
 	CellStyle *styles;
 